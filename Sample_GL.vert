@@ -3,8 +3,16 @@
 // input data : sent from main program
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
+// per instance, for instanced draws only (see struct Instance)
+layout (location = 2) in vec4 instancePlace;   // x, y, cos, sin
+layout (location = 3) in vec2 instanceSize;
+layout (location = 4) in vec3 instanceColor;
 
 uniform mat4 MVP;
+// color of the object; a vertex color (w,c,-) is drawn as w white plus c Color
+uniform vec3 Color;
+// true: place each copy by its instance attributes, which also give its color
+uniform bool Instanced;
 
 // output data : used by fragment shader
 out vec3 fragColor;
@@ -12,10 +20,17 @@ out vec3 fragColor;
 void main ()
 {
     vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    vec3 color = Color;
+    if (Instanced) {
+        vec2 p = vertexPosition.xy * instanceSize;
+        v.xy = instancePlace.xy + vec2(instancePlace.z * p.x - instancePlace.w * p.y,
+                                       instancePlace.w * p.x + instancePlace.z * p.y);
+        color = instanceColor;
+    }
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
-    fragColor = vertexColor;
+    fragColor = vec3(vertexColor.x) + vertexColor.y * color;
 
     // Output position of the vertex, in clip space : MVP * position
     gl_Position = MVP * v;
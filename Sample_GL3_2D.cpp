@@ -2,6 +2,11 @@
 #include <cmath>
 #include <fstream>
 #include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
+#include <thread>
+#include <atomic>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,6 +16,16 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Simulation.h"
+#include "Sim_Kernel.h"
+#include "Thread_Pool.h"
+#include "Triple_Buffer.h"
+#include "Sim_Input.h"
+#include "Sim_Batch.h"
+#include "Sim_Replay.h"
+#include "Sim_Rewind.h"
+#include "Sim_Profile.h"
+
 using namespace std;
 
 struct VAO {
@@ -21,78 +36,97 @@ struct VAO {
   GLenum PrimitiveMode;
   GLenum FillMode;
   int NumVertices;
+  // indexed meshes only: GLushort vertex numbers drawn, 0 otherwise
+  GLuint IndexBuffer;
+  int NumIndices;
+
+  // instanced VAOs only: copies drawn, from the stream buffer unless they
+  // were stored in InstanceBuffer to be drawn again unchanged
+  int NumInstances;
+  GLuint InstanceBuffer;
 };
 typedef struct VAO VAO;
 
+/* Placement and color of one copy of an instanced mesh; Sample_GL.vert
+   builds the transform from it */
+struct Instance {
+  GLfloat x,y;          // position
+  GLfloat c,s;          // rotation, as cos and sin
+  GLfloat w,h;          // size the unit mesh is scaled to
+  GLubyte color[4];     // rgb, a unused
+};
+
 struct GLMatrices {
   glm::mat4 projection;
   glm::mat4 model;
   GLuint MatrixID;
+  GLuint ColorID;
+  GLuint InstancedID;
   glm::mat4 view;
 } Matrices;
 
-struct Rectangle{
-  VAO *rect;
-  double a;
-  double b;
-  double x_pos,y_pos,angle;
-  int color;
-};
-
-struct Circle{
-  VAO *circle;
-  double a;
-  double b;
-  double x_pos,y_pos;
-  int color;
+/* Everything drawn besides bricks, bullets and the score (gun, bins, mirrors)
+   is an entity of the scene, stored as one array per component. Composite
+   objects are trees of parts: a part's world transform is its parent's
+   times its local one, so the gun's parts follow the gun when the sync
+   step sets one transform. Every shape is drawn from one unit mesh,
+   scaled by the entity's size and tinted with its color; circles pick
+   the mesh with the detail their size on screen needs. Bricks and bullets stay
+   in the snapshot's arrays, which are already laid out this way */
+enum Scene_Shape { SHAPE_NONE, SHAPE_RECT, SHAPE_CIRCLE };
+enum Scene_Layer { LAYER_BACK, LAYER_BINS, LAYER_FRONT };   // draw order around bricks and bullets
+
+struct Scene {
+  std::vector<int> parent;              // -1 for a root; parents come before children
+  std::vector<glm::mat4> local,world;   // transform
+  std::vector<int> shape;               // Scene_Shape
+  std::vector<glm::vec2> size;          // a,b of the shape
+  std::vector<int> color;
+  std::vector<int> layer;               // Scene_Layer
+  std::vector<char> visible;
+  std::vector<VAO *> mesh;              // unit mesh of the shape, NULL for a pure transform node
 };
 
-struct Mirror{
-  struct Rectangle rect;
+struct Scene scene;
+int gun_entity,barrel_entity,bin_entity[2];
+
+struct Game game;
+/* In the windowed game the simulation runs on sim_thread and owns game;
+   the render thread only draws the latest published snapshot (view) and
+   input callbacks only push events into input_ring */
+Triple_Buffer<struct Sim_Snapshot> snapshots;
+const struct Sim_Snapshot *view;
+struct Sim_Input_Ring input_ring;
+thread sim_thread;
+atomic<bool> sim_running(false);
+const char *record_path;          // --record: write the game here on exit
+struct Sim_Replay *replay;        // --replay: play this instead of input
+struct Sim_Rewind rewind_ring;    // R goes back a second
+struct Game level;                // mirrors of --level / --mirrors, copied into each new game
+const char *profile_path;         // --profile: write the phase timings here on exit
+struct Sim_Profile sim_profile;   // written by the sim thread
+struct Sim_Profile sim_profile_copy;
+struct Sim_Profile render_profile;
+struct Sim_Profile *draw_profile;  // render_profile once timing is on (--profile or P), else NULL
+bool draw_armed;                   // P: time the frames from the next one on
+atomic<int> profile_request(0);   // P: 1 asks the sim thread to start timing or for a copy, 2 once it is made
+/* Phases of a window frame; GL calls are timed as submitted, not as drawn */
+enum Draw_Phase {
+  DRAW_MOUSE,DRAW_SCENE,DRAW_BACK,DRAW_SCORE,DRAW_BRICKS,DRAW_BINS,DRAW_BULLETS,
+  DRAW_AIM,DRAW_FRONT,DRAW_SWAP,DRAW_FENCE,DRAW_FRAME,DRAW_PHASES
 };
-struct Mirror mirror[4];
-
-struct Bin {
-  struct Circle top,bottom;
-  struct Rectangle rect;
-  double bin_height;
-  double bin_width;
-  double x_pos;
-  double y_pos;
+const char *const draw_phase_name[DRAW_PHASES]={
+  "mouse","scene","back","score","bricks","bins","bullets","aim","front","swap","fence","frame"
 };
-
-struct Gun {
-  struct Rectangle rect1,rect2;
-  struct Circle circle1,circle2;
-  double rot_angle;
-  double y_pos;
-  double x_pos;
-};
-struct Bricks{
-  struct Rectangle brick[100];
-  int pointer;
-  int bricks_count;
-};
-struct Bullets{
-  struct Rectangle bullet[10];
-  int pointer;
-  int count;
-};
-
-struct Display
-{
-  struct Rectangle segment[7];
-};
-
-struct Display display;
-
-struct Bin bin[2];
-struct Gun gun;
-struct Bricks bricks;
-struct Bullets bullets;
+#define CIRCLE_LODS 5               // circles of 8, 16, 32, 64 and 128 segments
+#define CIRCLE_SEGMENTS 8
+VAO *rect_mesh,*circle_mesh[CIRCLE_LODS];   // unit meshes shared by everything drawn
+VAO *brick_instances,*bullet_instances,*score_instances;   // rect_mesh once per brick, per bullet, per lit segment
+int score_shown=-1;               // score in score_instances, -1 before the first frame
+vector<struct Instance> instances;        // filled anew for each instanced draw
+VAO *aim_path;                    // predicted shot, refilled every frame
 GLFWwindow* window;
 GLuint programID;
-void CreateBullet();
 /* Function to load Shaders - Use it as it is */
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
 
@@ -175,8 +209,88 @@ static void error_callback(int error, const char* description)
   fprintf(stderr, "Error: %s\n", description);
 }
 
+/* Advance the game in real time and publish a snapshot after every tick
+   batch. Never waits on the renderer, so a vsync stall does not hold back
+   the simulation */
+void SimulationLoop()
+{
+  chrono::steady_clock::time_point last=chrono::steady_clock::now();
+  while(sim_running.load())
+  {
+    chrono::steady_clock::time_point now=chrono::steady_clock::now();
+    if(Sim_Advance(&game,chrono::duration<double>(now-last).count())>0)
+    {
+      Sim_Snapshot_Take(&game,&snapshots.Write_Slot());
+      snapshots.Publish();
+    }
+    if(profile_request.load()==1)
+    {
+      // the tick timers cost real time, so they only run once asked for
+      if(!game.profile)
+      {
+        game.profile=&sim_profile;
+        cout << "Profiling, press P again to write the timings" << endl;
+        profile_request=0;
+      }
+      else
+      {
+        sim_profile_copy=sim_profile;
+        profile_request=2;
+      }
+    }
+    last=now;
+    this_thread::sleep_for(chrono::duration<double>(game.dt-game.accumulator));
+  }
+}
+
+void StartSimulation()
+{
+  Sim_Snapshot_Take(&game,&snapshots.Write_Slot());
+  snapshots.Publish();
+  view=&snapshots.Read();
+  Input_Ring_Init(&input_ring);
+  if(!game.replay)
+    game.input=&input_ring;
+  game.input_epoch=Input_Clock();
+  sim_running=true;
+  sim_thread=thread(SimulationLoop);
+}
+
+/* Write the sim and render timings to --profile, or profile.csv */
+void WriteProfile(const struct Sim_Profile *sim)
+{
+  const struct Sim_Profile *profiles[2]={sim,&render_profile};
+  const char *path=profile_path ? profile_path : "profile.csv";
+  if(Profile_Write(profiles,2,path))
+    cout << "Profile written to " << path << endl;
+}
+
+void StopSimulation()
+{
+  sim_running=false;
+  if(sim_thread.joinable())
+    sim_thread.join();
+  if(profile_path && game.profile)
+    WriteProfile(game.profile);
+  game.profile=NULL;
+  if(game.recorder)
+    Recorder_Close(game.recorder,&game,record_path);
+  game.recorder=NULL;
+  if(replay)
+  {
+    Replay_Check(replay,&game);
+    Replay_Close(replay);
+  }
+  replay=NULL;
+  game.replay=NULL;
+}
+
+void DestroyMeshes();
+
 void quit(GLFWwindow *window)
 {
+  StopSimulation();
+  DestroyMeshes();
   glfwDestroyWindow(window);
   glfwTerminate();
   exit(EXIT_SUCCESS);
@@ -190,6 +304,10 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
   vao->PrimitiveMode = primitive_mode;
   vao->NumVertices = numVertices;
   vao->FillMode = fill_mode;
+  vao->NumInstances = 0;
+  vao->InstanceBuffer = 0;
+  vao->IndexBuffer = 0;
+  vao->NumIndices = 0;
 
   // Create Vertex Array Object
   // Should be done after CreateWindow and before any other GL calls
@@ -233,7 +351,252 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
     color_buffer_data [3*i + 2] = blue;
   }
 
-  return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+  struct VAO* vao = create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+  delete [] color_buffer_data;
+  return vao;
+}
+
+/* Generate VAO, VBOs and return VAO handle - triangles drawn through an
+   index buffer, so shared vertices are stored once */
+struct VAO* createIndexed3DObject (int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, int numIndices, const GLushort* index_buffer_data)
+{
+  struct VAO* vao = create3DObject(GL_TRIANGLES, numVertices, vertex_buffer_data, color_buffer_data, GL_FILL);
+  vao->NumIndices = numIndices;
+  glGenBuffers (1, &(vao->IndexBuffer));
+  // the element buffer binding is part of the VAO, which is still bound
+  glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, vao->IndexBuffer);
+  glBufferData (GL_ELEMENT_ARRAY_BUFFER, numIndices*sizeof(GLushort), index_buffer_data, GL_STATIC_DRAW);
+  return vao;
+}
+
+/* Ring for data rewritten every frame (instances, the aim path): one buffer
+   in STREAM_REGIONS regions, each filled by one frame while the GPU may
+   still read the others. A fence is set when a frame is done with its
+   region and checked before the region is filled again, so writes never
+   wait on the driver: with ARB_buffer_storage the buffer stays mapped,
+   otherwise each write maps its range unsynchronized */
+#define STREAM_REGIONS 3
+#define STREAM_REGION_SIZE (1<<20)   // initial bytes per region, grows to fit a frame
+#define STREAM_ALIGN 64
+
+struct Stream_Buffer {
+  GLuint Buffer;
+  GLsizeiptr RegionSize;
+  int Region;                      // region being filled
+  GLsizeiptr Offset;               // next free byte in it
+  GLsync Fence[STREAM_REGIONS];    // 0 once the GPU is known to be done
+  unsigned char *Mapped;           // persistent mapping, NULL without buffer storage
+  // fences checked, those the GPU had not passed yet, and the time spent waiting
+  long Checks,Waits;
+  double Wait_us,Max_Wait_us;
+};
+struct Stream_Buffer stream;
+
+void createStreamBuffer (struct Stream_Buffer* sb, GLsizeiptr regionSize)
+{
+  GLsizeiptr size = STREAM_REGIONS*regionSize;
+  sb->RegionSize = regionSize;
+  sb->Region = 0;
+  sb->Offset = 0;
+  for (int r=0; r<STREAM_REGIONS; r++)
+    sb->Fence[r] = 0;
+  sb->Mapped = NULL;
+  glGenBuffers (1, &(sb->Buffer));
+  glBindBuffer (GL_ARRAY_BUFFER, sb->Buffer);
+  if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage (GL_ARRAY_BUFFER, size, NULL, flags);
+    sb->Mapped = (unsigned char*)glMapBufferRange (GL_ARRAY_BUFFER, 0, size, flags);
+  }
+  else
+    glBufferData (GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+}
+
+void destroyStreamBuffer (struct Stream_Buffer* sb)
+{
+  for (int r=0; r<STREAM_REGIONS; r++)
+    if (sb->Fence[r])
+      glDeleteSync (sb->Fence[r]);
+  if (sb->Mapped) {
+    glBindBuffer (GL_ARRAY_BUFFER, sb->Buffer);
+    glUnmapBuffer (GL_ARRAY_BUFFER);
+  }
+  glDeleteBuffers (1, &(sb->Buffer));
+  sb->Buffer = 0;
+  sb->Mapped = NULL;
+}
+
+/* Done with the current region: fence it and move on to the next. Called
+   after each frame, and when a frame does not fit in one region */
+void streamNextRegion (struct Stream_Buffer* sb)
+{
+  if (sb->Offset == 0)
+    return;
+  sb->Fence[sb->Region] = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  sb->Region = (sb->Region+1) % STREAM_REGIONS;
+  sb->Offset = 0;
+}
+
+/* Block until the GPU no longer reads the current region */
+void streamWait (struct Stream_Buffer* sb)
+{
+  GLsync fence = sb->Fence[sb->Region];
+  if (!fence)
+    return;
+  double start = Profile_Now();
+  sb->Checks++;
+  if (glClientWaitSync (fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+    sb->Waits++;
+    while (glClientWaitSync (fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+      ;
+  }
+  double us = Profile_Now()-start;
+  sb->Wait_us += us;
+  sb->Max_Wait_us = max(sb->Max_Wait_us, us);
+  if (draw_profile)
+    Profile_Add(draw_profile, DRAW_FENCE, us);
+  glDeleteSync (fence);
+  sb->Fence[sb->Region] = 0;
+}
+
+/* Copy size bytes into the ring; returns their offset in sb->Buffer, valid
+   for this frame's draws */
+GLintptr streamUpload (struct Stream_Buffer* sb, const void* data, GLsizeiptr size)
+{
+  if (size > sb->RegionSize) {
+    // outgrown: start over with regions big enough; draws already issued
+    // keep the old buffer alive until they are done
+    GLsizeiptr regionSize = sb->RegionSize;
+    while (regionSize < size)
+      regionSize *= 2;
+    destroyStreamBuffer (sb);
+    createStreamBuffer (sb, regionSize);
+  }
+  if (sb->Offset + size > sb->RegionSize)
+    streamNextRegion (sb);
+  if (sb->Offset == 0)
+    streamWait (sb);
+  GLintptr offset = sb->Region*sb->RegionSize + sb->Offset;
+  if (sb->Mapped)
+    memcpy (sb->Mapped + offset, data, size);
+  else {
+    glBindBuffer (GL_ARRAY_BUFFER, sb->Buffer);
+    void* p = glMapBufferRange (GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    memcpy (p, data, size);
+    glUnmapBuffer (GL_ARRAY_BUFFER);
+  }
+  sb->Offset += (size + STREAM_ALIGN-1) / STREAM_ALIGN * STREAM_ALIGN;
+  return offset;
+}
+
+void streamReport (const struct Stream_Buffer* sb)
+{
+  cout << "Stream buffer: " << (sb->Mapped ? "persistent" : "unsynchronized") << " map, "
+       << STREAM_REGIONS << " x " << sb->RegionSize/1024 << " KB, fence waits "
+       << sb->Waits << "/" << sb->Checks << ", " << sb->Wait_us << " us total, "
+       << sb->Max_Wait_us << " us max" << endl;
+}
+
+/* VAO for vertices rewritten every frame, drawn in the Color uniform; fill
+   it with streamVertices before drawing */
+struct VAO* createStreamObject (GLenum primitive_mode, int maxVertices)
+{
+  struct VAO* vao = create3DObject(primitive_mode, maxVertices, NULL, 0, 1, 0);
+  glDeleteBuffers (1, &(vao->VertexBuffer));   // vertices come from the stream buffer
+  vao->VertexBuffer = 0;
+  vao->NumVertices = 0;
+  return vao;
+}
+
+/* Upload the vertices of a stream VAO for this frame */
+void streamVertices (struct VAO* vao, const GLfloat* vertex_buffer_data, int numVertices)
+{
+  vao->NumVertices = numVertices;
+  if (numVertices == 0)
+    return;
+  GLintptr offset = streamUpload(&stream, vertex_buffer_data, 3*numVertices*sizeof(GLfloat));
+  glBindVertexArray (vao->VertexArrayID);
+  glBindBuffer (GL_ARRAY_BUFFER, stream.Buffer);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+}
+
+/* VAO that draws mesh once per Instance, with a single draw call; fill it
+   with streamInstances. Shares the vertex and color buffers of mesh, which
+   must outlive it */
+struct VAO* createInstancedObject (struct VAO* mesh)
+{
+  struct VAO* vao = new struct VAO;
+  *vao = *mesh;
+  vao->VertexBuffer = vao->ColorBuffer = 0;   // not ours to free
+  vao->NumInstances = 0;
+  vao->InstanceBuffer = 0;
+  vao->IndexBuffer = 0;
+  glGenVertexArrays(1, &(vao->VertexArrayID));
+
+  glBindVertexArray (vao->VertexArrayID);
+  if (mesh->IndexBuffer)
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, mesh->IndexBuffer);
+  glBindBuffer (GL_ARRAY_BUFFER, mesh->VertexBuffer);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+  glEnableVertexAttribArray(0);
+  glBindBuffer (GL_ARRAY_BUFFER, mesh->ColorBuffer);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+  glEnableVertexAttribArray(1);
+  // per instance: 2 place (x,y,c,s), 3 size (w,h), 4 color; pointed at
+  // by streamInstances or storeInstances
+  for (int i=2; i<=4; i++) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
+  return vao;
+}
+
+/* Point the per instance attributes at Instance records in buffer */
+void pointInstances (struct VAO* vao, GLuint buffer, GLintptr offset)
+{
+  glBindVertexArray (vao->VertexArrayID);
+  glBindBuffer (GL_ARRAY_BUFFER, buffer);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(struct Instance), (void*)(offset+offsetof(struct Instance, x)));
+  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(struct Instance), (void*)(offset+offsetof(struct Instance, w)));
+  glVertexAttribPointer(4, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct Instance), (void*)(offset+offsetof(struct Instance, color)));
+}
+
+/* Upload the instances of an instanced VAO for this frame */
+void streamInstances (struct VAO* vao, const struct Instance* instances, int numInstances)
+{
+  vao->NumInstances = numInstances;
+  if (numInstances == 0)
+    return;
+  pointInstances(vao, stream.Buffer, streamUpload(&stream, instances, numInstances*sizeof(struct Instance)));
+}
+
+/* Keep the instances of an instanced VAO in a buffer of its own, drawn
+   every frame until they are stored again */
+void storeInstances (struct VAO* vao, const struct Instance* instances, int numInstances)
+{
+  vao->NumInstances = numInstances;
+  if (numInstances == 0)
+    return;
+  if (!vao->InstanceBuffer)
+    glGenBuffers (1, &(vao->InstanceBuffer));
+  glBindBuffer (GL_ARRAY_BUFFER, vao->InstanceBuffer);
+  glBufferData (GL_ARRAY_BUFFER, numInstances*sizeof(struct Instance), instances, GL_DYNAMIC_DRAW);
+  pointInstances(vao, vao->InstanceBuffer, 0);
+}
+
+/* Render every instance of an instanced VAO */
+void drawInstanced3DObject (struct VAO* vao)
+{
+  if (vao->NumInstances == 0)
+    return;
+  glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+  glBindVertexArray (vao->VertexArrayID);
+  glUniform1i(Matrices.InstancedID, 1);
+  if (vao->NumIndices)
+    glDrawElementsInstanced(vao->PrimitiveMode, vao->NumIndices, GL_UNSIGNED_SHORT, (void*)0, vao->NumInstances);
+  else
+    glDrawArraysInstanced(vao->PrimitiveMode, 0, vao->NumVertices, vao->NumInstances);
+  glUniform1i(Matrices.InstancedID, 0);
 }
 
 /* Render the VBOs handled by VAO */
@@ -256,20 +619,33 @@ void draw3DObject (struct VAO* vao)
   glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
 
   // Draw the geometry !
-  glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+  if (vao->NumIndices)
+    glDrawElements(vao->PrimitiveMode, vao->NumIndices, GL_UNSIGNED_SHORT, (void*)0);
+  else
+    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+}
+
+/* Free the VBOs and the VAO */
+void destroy3DObject (struct VAO* vao)
+{
+  if (!vao)
+    return;
+  glDeleteBuffers (1, &(vao->VertexBuffer));
+  glDeleteBuffers (1, &(vao->ColorBuffer));
+  glDeleteBuffers (1, &(vao->InstanceBuffer));
+  glDeleteBuffers (1, &(vao->IndexBuffer));
+  glDeleteVertexArrays (1, &(vao->VertexArrayID));
+  delete vao;
 }
 
 /**************************
 * Customizable functions *
 **************************/
-double time_to_hit_space= glfwGetTime(), current_time;
-double Speed_of_Brick=0.01;
 float triangle_rot_dir = 1;
 float rectangle_rot_dir = 1;
 bool triangle_rot_status = true;
 bool rectangle_rot_status = true;
 bool RIGHT_control=false,RIGHT=false,LEFT=false,RIGHT_alt=false;
-int Score=0;
 int fbwidth,fbheight;
 double zoom=0;
 //float rot_angle=0;
@@ -282,36 +658,33 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
   if (action == GLFW_RELEASE) {
     switch (key) {
       case GLFW_KEY_A:
-      if(gun.rot_angle<80)
-      gun.rot_angle+=5;
+      Input_Push(&input_ring,SIM_INPUT_ROTATE_GUN,0,5,0);
       break;
       case GLFW_KEY_D:
-      if(gun.rot_angle>-80)
-      gun.rot_angle-=5;
+      Input_Push(&input_ring,SIM_INPUT_ROTATE_GUN,0,-5,0);
       break;
       case GLFW_KEY_SPACE:
-      current_time=glfwGetTime();
-      if(current_time - time_to_hit_space>=0.5)
-      {
-        CreateBullet();
-        time_to_hit_space=current_time;
-      }
+      Input_Push(&input_ring,SIM_INPUT_FIRE);
       break;
       case GLFW_KEY_S:
-      if(gun.y_pos<3.5)
-      gun.y_pos+=0.2;
+      Input_Push(&input_ring,SIM_INPUT_MOVE_GUN,0,0.2,0);
       break;
       case GLFW_KEY_F:
-      if(gun.y_pos>-3.5)
-      gun.y_pos-=0.2;
+      Input_Push(&input_ring,SIM_INPUT_MOVE_GUN,0,-0.2,0);
       break;
       case GLFW_KEY_N:
-      if(Speed_of_Brick<0.05)
-      Speed_of_Brick+=0.005;
+      Input_Push(&input_ring,SIM_INPUT_BRICK_SPEED,0,0.005,0);
       break;
       case GLFW_KEY_M:
-      if(Speed_of_Brick>0.01)
-      Speed_of_Brick-=0.005;
+      Input_Push(&input_ring,SIM_INPUT_BRICK_SPEED,0,-0.005,0);
+      break;
+      case GLFW_KEY_R:
+      Input_Push(&input_ring,SIM_INPUT_REWIND,0,1,0);
+      break;
+      case GLFW_KEY_P:
+      draw_armed=true;
+      if(profile_request.load()==0)
+        profile_request=1;
       break;
       case GLFW_KEY_RIGHT_CONTROL:
       RIGHT_control=false;
@@ -357,13 +730,13 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
     }
   }
   if(RIGHT_control==true &&RIGHT==true)
-  bin[0].x_pos+=0.2;
+  Input_Push(&input_ring,SIM_INPUT_MOVE_BIN,0,0.2,0);
   if(RIGHT_control==true && LEFT==true )
-  bin[0].x_pos-=0.2;
+  Input_Push(&input_ring,SIM_INPUT_MOVE_BIN,0,-0.2,0);
   if(RIGHT_alt==true && RIGHT==true)
-  bin[1].x_pos+=0.2;
+  Input_Push(&input_ring,SIM_INPUT_MOVE_BIN,1,0.2,0);
   if(RIGHT_alt==true  && LEFT==true )
-  bin[1].x_pos-=0.2;
+  Input_Push(&input_ring,SIM_INPUT_MOVE_BIN,1,-0.2,0);
 }
 
 /* Executed for character input (like in text boxes) */
@@ -381,6 +754,8 @@ void keyboardChar (GLFWwindow* window, unsigned int key)
 bool mouse_left=false;
 bool bin0=false,bin1=false,gun0=false;
 double x_pos,y_pos;
+bool aiming=false;                // left button held away from the bins and gun
+double aim_angle;                 // angle towards the cursor while aiming
 
 /* Executed when a mouse button is pressed/released */
 void mouseButton (GLFWwindow* window, int button, int action, int mods)
@@ -393,16 +768,16 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
       glfwGetCursorPos(window,&x_pos,&y_pos);
       double temp_x=8*((x_pos-fbwidth/2)/fbwidth*1.0);
       double temp_y=-8*((y_pos-fbheight/2)/fbheight*1.0);
-      if(bin[0].x_pos-bin[0].bin_width/2<=temp_x&&bin[0].x_pos+bin[0].bin_width/2>=temp_x)
-      if(bin[0].y_pos>=temp_y&&bin[0].y_pos-bin[0].bin_height<=temp_y)
+      if(view->bin[0].x_pos-view->bin[0].bin_width/2<=temp_x&&view->bin[0].x_pos+view->bin[0].bin_width/2>=temp_x)
+      if(view->bin[0].y_pos>=temp_y&&view->bin[0].y_pos-view->bin[0].bin_height<=temp_y)
       bin0=true;
 
-      if(bin[1].x_pos-bin[1].bin_width/2<=temp_x&&bin[1].x_pos+bin[1].bin_width/2>=temp_x)
-      if(bin[1].y_pos>=temp_y&&bin[1].y_pos-bin[1].bin_height<=temp_y)
+      if(view->bin[1].x_pos-view->bin[1].bin_width/2<=temp_x&&view->bin[1].x_pos+view->bin[1].bin_width/2>=temp_x)
+      if(view->bin[1].y_pos>=temp_y&&view->bin[1].y_pos-view->bin[1].bin_height<=temp_y)
       bin1=true;
 
-      if(gun.x_pos-gun.rect1.a/2<=temp_x&&gun.x_pos+gun.rect1.a/2>=temp_x)
-      if(gun.y_pos>=temp_y&&gun.y_pos-gun.rect1.b<=temp_y)
+      if(view->gun.x_pos-view->gun.rect1.a/2<=temp_x&&view->gun.x_pos+view->gun.rect1.a/2>=temp_x)
+      if(view->gun.y_pos>=temp_y&&view->gun.y_pos-view->gun.rect1.b<=temp_y)
       gun0=true;
     }
     if (action == GLFW_RELEASE)
@@ -411,6 +786,7 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
       bin1=false;
       gun0=false;
       mouse_left=false;
+      aiming=false;
     }
     break;
 
@@ -479,79 +855,79 @@ void createTriangle ()
   // create3DObject creates and returns a handle to a VAO that can be used later
 }
 
-// Creates the rectangle object used in this sample code
-void CreateRectangle (float length,float breadth,int c,VAO **object)
+/* Colors of the palette, picked by the color index of an entity */
+const glm::vec3 palette[4]={glm::vec3(1,0,0),glm::vec3(0,1,0),glm::vec3(0,0,1),glm::vec3(0,0,0)};
+
+/* Unit meshes are shaded by (white, color) weights per vertex and take
+   their color from the Color uniform, see Sample_GL.vert */
+void setColor (int c)
+{
+  glUniform3fv(Matrices.ColorID, 1, &palette[c][0]);
+}
+
+// Creates the unit rectangle: 1 wide, 1 deep below its top edge, scaled to
+// length x breadth when drawn; the color fades to white at the top
+void CreateRectangle (VAO **object)
 {
-  int r=0,g=0,b=0;
-  if(c==0) r=1;
-  if(c==1) g=1;
-  if(c==2) b=1;
   // GL3 accepts only Triangles. Quads are not supported
-  GLfloat vertex_buffer_data [] = {
-    -length/2,-breadth,0, // vertex 1
-    -length/2,0,0, // vertex 2
-    length/2, 0,0, // vertex 3
-
-    length/2, 0,0, // vertex 3
-    length/2, -breadth,0, // vertex 4
-    -length/2,-breadth,0  // vertex 1
+  static const GLfloat vertex_buffer_data [] = {
+    -0.5,-1,0, // vertex 1
+    -0.5,0,0, // vertex 2
+    0.5, 0,0, // vertex 3
+
+    0.5, 0,0, // vertex 3
+    0.5, -1,0, // vertex 4
+    -0.5,-1,0  // vertex 1
   };
-  GLfloat color_buffer_data [] = {
-    r,g,b, // color 1
-    1,1,1, // color 2
-    1,1,1, // color 3
-
-    1,1,1, // color 3
-    r,g,b, // color 4
-    r,g,b  // color 1
+  static const GLfloat color_buffer_data [] = {
+    0,1,0, // color 1
+    1,0,0, // white 2
+    1,0,0, // white 3
+
+    1,0,0, // white 3
+    0,1,0, // color 4
+    0,1,0  // color 1
   };
   // create3DObject creates and returns a handle to a VAO that can be used later
   *object = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
-const float DEG2RAD = 3.14159/180;
-// Creates the circle object used in this sample code
-void createCircle (float a,float b,int c,VAO **object)
+// Creates the unit circle, scaled to radii a,b when drawn: light grey in the
+// middle, 0.8 of the color at the rim. An indexed fan of segments triangles
+// around one center vertex
+void createCircle (VAO **object, int segments)
 {
-  GLfloat vertex_buffer_data [9*360];
-  for(int i=0;i<360;i++)
-  for(int j=0;j<3;j++)
+  vector<GLfloat> vertex_buffer_data(3*(segments+1),0),color_buffer_data(3*(segments+1),0);
+  vector<GLushort> index_buffer_data(3*segments);
+  color_buffer_data[0]=0.8;
+  for(int i=0;i<segments;i++)
   {
-    for(int k=0;k<3;k++)
-    {
-      if(k==0)
-      vertex_buffer_data[i*9+j*3+k]=floor((j+1)/2)*cos((i+floor(j/2))*DEG2RAD)*(a);
-      if(k==1)
-      vertex_buffer_data[i*9+j*3+k]=floor((j+1)/2)*sin((i+floor(j/2))*DEG2RAD)*(b);
-      if(k==2)
-      vertex_buffer_data[i*9+j*3+k]=0;
-    }
-  }
-  GLfloat color_buffer_data [9*360];
-  for(int i=0;i<360;i++)
-    for(int j=0;j<3;j++)
-      for(int k=0;k<3;k++)
-      {
-        if(j==0)
-          color_buffer_data[i*9+j*3+k]=0.8;
-        else if(j!=0 && k==c)
-          color_buffer_data[i*9+j*3+k]=0.8*floor((j+1)/2);
-        else
-        color_buffer_data[i*9+j*3+k]=0;
+    double angle=2*M_PI*i/segments;
+    vertex_buffer_data[3*(i+1)]=cos(angle);
+    vertex_buffer_data[3*(i+1)+1]=sin(angle);
+    color_buffer_data[3*(i+1)+1]=0.8;
+    index_buffer_data[3*i]=0;
+    index_buffer_data[3*i+1]=i+1;
+    index_buffer_data[3*i+2]=(i+1)%segments+1;
   }
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  *object = create3DObject(GL_TRIANGLES, 3*360, vertex_buffer_data, color_buffer_data, GL_FILL);
+  *object = createIndexed3DObject(segments+1, vertex_buffer_data.data(), color_buffer_data.data(), 3*segments, index_buffer_data.data());
+}
+
+/* Circle mesh with just enough segments for a circle of radius world units
+   at the current zoom: its rim strays at most half a pixel from the true
+   circle, which takes pi*sqrt(radius in pixels) segments */
+VAO *Circle_Mesh(float radius)
+{
+  float pixels=radius*max(fbwidth,fbheight)/fabs(8-2*zoom);
+  float needed=M_PI*sqrt(max(pixels,0.0f));
+  int lod=0;
+  while(lod<CIRCLE_LODS-1 && (CIRCLE_SEGMENTS<<lod)<needed)
+    lod++;
+  return circle_mesh[lod];
 }
 
 float camera_rotation_angle = 90;
 float rectangle_rotation = 0;
 float triangle_rotation = 0;
-double last_update_time = glfwGetTime();
-double last_update_time1 = glfwGetTime();
-
-double check(double x1,double y1,double x2,double y2,double x,double y)
-{
-  return (y1-y2)*(x-x1)-(x1-x2)*(y-y1);
-}
 
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
@@ -573,365 +949,248 @@ void moveTriangle(glm::mat4 VP,glm::vec3 translate)
   // draw3DObject draws the VAO given to it using current MVP matrix
   draw3DObject(triangle);
 }
-void CreateBin(struct Bin* bin,int c)
+/* The unit meshes; spawning a brick or a bullet makes no GL calls */
+void CreateMeshes()
 {
-  bin->bin_height=1;bin->bin_width=0.8;
-  bin->rect.a=bin->bin_width;bin->rect.b=bin->bin_height;bin->rect.color=c;
-  bin->top.a=bin->bin_width/2;bin->bottom.a=bin->bin_width/2;
-  bin->top.b=bin->bin_width/2;bin->bottom.b=bin->bin_width/2;
-  bin->top.color=c;bin->bottom.color=c;
-  CreateRectangle (bin->rect.a,bin->rect.b,bin->rect.color,&bin->rect.rect);
-  createCircle (bin->top.a,bin->top.b,bin->top.color,&bin->top.circle);
-  createCircle (bin->bottom.a,bin->bottom.b,bin->bottom.color,&bin->bottom.circle);
+  CreateRectangle(&rect_mesh);
+  for(int lod=0;lod<CIRCLE_LODS;lod++)
+    createCircle(&circle_mesh[lod],CIRCLE_SEGMENTS<<lod);
+  brick_instances=createInstancedObject(rect_mesh);
+  bullet_instances=createInstancedObject(rect_mesh);
+  score_instances=createInstancedObject(rect_mesh);
+  score_shown=-1;
 }
-
-void CreateGun(struct Gun* gun,int c)
+/* Free the GL objects made by initGL, on quit */
+void DestroyMeshes()
 {
-  gun->circle1.a=0.05;gun->circle1.b=0.1;gun->circle1.color=c;
-  gun->circle2.a=0.25;gun->circle2.b=0.25;gun->circle2.color=c;
-  createCircle(gun->circle1.a,gun->circle1.b,gun->circle1.color,&gun->circle1.circle);
-  createCircle(gun->circle2.a,gun->circle2.b,gun->circle2.color,&gun->circle2.circle);
-  gun->rect1.a=0.4;gun->rect1.b=0.4;gun->rect1.color=c;
-  gun->rect2.a=0.6;gun->rect2.b=0.2;gun->rect2.color=c;
-  CreateRectangle(gun->rect1.a,gun->rect1.b,gun->rect1.color,&gun->rect1.rect);
-  CreateRectangle(gun->rect2.a,gun->rect2.b,gun->rect2.color,&gun->rect2.rect);
+  streamReport(&stream);
+  destroyStreamBuffer(&stream);
+  destroy3DObject(brick_instances);
+  destroy3DObject(bullet_instances);
+  destroy3DObject(score_instances);
+  brick_instances=bullet_instances=score_instances=NULL;
+  destroy3DObject(rect_mesh);
+  for(int lod=0;lod<CIRCLE_LODS;lod++)
+  {
+    destroy3DObject(circle_mesh[lod]);
+    circle_mesh[lod]=NULL;
+  }
+  destroy3DObject(aim_path);
+  rect_mesh=aim_path=NULL;
 }
-void CreateBrick()
+VAO *Scene_Mesh(int shape)
 {
-  int i=(bricks.pointer+bricks.bricks_count)%100;
-  bricks.brick[i].x_pos=(rand()%11-5)/2.5;
-  bricks.brick[i].y_pos=4.0;
-  bricks.brick[i].color=rand()%3;
-  if(bricks.brick[i].color==2)
-  bricks.brick[i].color++;
-  bricks.brick[i].a=0.2;
-  bricks.brick[i].b=0.4;
-  CreateRectangle(bricks.brick[i].a,bricks.brick[i].b,bricks.brick[i].color,&bricks.brick[i].rect);
-  bricks.bricks_count+=1;
+  return shape==SHAPE_RECT ? rect_mesh : shape==SHAPE_CIRCLE ? circle_mesh[CIRCLE_LODS-1] : NULL;
 }
-void CreateBullet()
+
+int Scene_Add(struct Scene *scene,int parent,glm::mat4 local,int shape,glm::vec2 size,int color,int layer)
 {
-  int i=(bullets.pointer+bullets.count)%10;
-  double gun_length = gun.rect1.a+gun.rect2.a;
-  bullets.bullet[i].angle=gun.rot_angle;
-  bullets.bullet[i].x_pos=-gun.rect1.a/2+gun.x_pos+gun_length*cos((bullets.bullet[i].angle)*M_PI/180.0f);
-  bullets.bullet[i].y_pos=-gun.rect1.b/2+gun.y_pos+gun_length*sin((bullets.bullet[i].angle)*M_PI/180.0f);
-  bullets.bullet[i].a=gun.rect2.b/3;bullets.bullet[i].b=0.8;
-  bullets.bullet[i].color=3;
-  CreateRectangle(bullets.bullet[i].a,bullets.bullet[i].b,bullets.bullet[i].color,&bullets.bullet[i].rect);
-  bullets.count+=1;
+  scene->parent.push_back(parent);
+  scene->local.push_back(local);
+  scene->world.push_back(local);
+  scene->shape.push_back(shape);
+  scene->size.push_back(size);
+  scene->color.push_back(color);
+  scene->layer.push_back(layer);
+  scene->visible.push_back(1);
+  scene->mesh.push_back(Scene_Mesh(shape));
+  return scene->parent.size()-1;
 }
-void CreateMirror()
+
+/* Build the entities once; Scene_Sync moves them every frame */
+void CreateScene(struct Scene *scene)
 {
-  mirror[0].rect.angle=-135;mirror[0].rect.a=1.2;mirror[0].rect.b=0.05;
-  mirror[0].rect.x_pos=3;mirror[0].rect.y_pos=-1.5;
-  CreateRectangle(mirror[0].rect.a,mirror[0].rect.b,3,&mirror[0].rect.rect);
-  mirror[1].rect.angle=135;mirror[1].rect.a=1.2;mirror[1].rect.b=0.05;
-  mirror[1].rect.x_pos=3;mirror[1].rect.y_pos=1.5;
-  CreateRectangle(mirror[1].rect.a,mirror[1].rect.b,3,&mirror[1].rect.rect);
-  mirror[2].rect.angle=90;mirror[2].rect.a=1.2;mirror[2].rect.b=0.05;
-  mirror[2].rect.x_pos=3.5;mirror[2].rect.y_pos=0;
-  CreateRectangle(mirror[2].rect.a,mirror[2].rect.b,3,&mirror[2].rect.rect);
+  const struct Sim_Gun &g=game.gun;
+  const float a1=g.rect1.a,b1=g.rect1.b,a2=g.rect2.a,b2=g.rect2.b;
+  gun_entity=Scene_Add(scene,-1,glm::mat4(1.0f),SHAPE_NONE,glm::vec2(0),0,LAYER_BACK);
+  // the barrel turns about the gun's lower left corner
+  barrel_entity=Scene_Add(scene,gun_entity,glm::mat4(1.0f),SHAPE_NONE,glm::vec2(0),0,LAYER_BACK);
+  Scene_Add(scene,barrel_entity,glm::translate(glm::vec3(a1/2,b1/2,0)),SHAPE_RECT,glm::vec2(a1,b1),3,LAYER_BACK);
+  Scene_Add(scene,barrel_entity,glm::translate(glm::vec3(a1+a2/2,b2/2,0)),SHAPE_RECT,glm::vec2(a2,b2),3,LAYER_BACK);
+  Scene_Add(scene,barrel_entity,glm::translate(glm::vec3(a1+a2,0,0)),SHAPE_CIRCLE,glm::vec2(0.05,0.1),3,LAYER_BACK);
+  Scene_Add(scene,gun_entity,glm::translate(glm::vec3(-a1/2,-b1/2,0)),SHAPE_CIRCLE,glm::vec2(0.25,0.25),3,LAYER_BACK);
+
+  // bins: a box and its rim and base, two circles tilted back and forth by 70 degrees
+  for(int i=0;i<2;i++)
+  {
+    const struct Sim_Bin &bin=game.bin[i];
+    glm::vec2 rim(bin.bin_width/2,bin.bin_width/2);
+    glm::vec3 axis(1,0,0);
+    bin_entity[i]=Scene_Add(scene,-1,glm::mat4(1.0f),SHAPE_RECT,glm::vec2(bin.bin_width,bin.bin_height),bin.color,LAYER_BINS);
+    Scene_Add(scene,bin_entity[i],glm::rotate((float)(-70*M_PI/180.0f),axis),SHAPE_CIRCLE,rim,bin.color,LAYER_BINS);
+    Scene_Add(scene,bin_entity[i],glm::translate(glm::vec3(0,-bin.bin_height,0))*glm::rotate((float)(70*M_PI/180.0f),axis),SHAPE_CIRCLE,rim,bin.color,LAYER_BINS);
+  }
 
+  // mirrors never move
+  for(int i=0;i<game.mirror_count;i++)
+  {
+    const struct Sim_Body &mirror=game.mirror[i];
+    glm::mat4 place=glm::translate(glm::vec3(mirror.x_pos,mirror.y_pos,0))*glm::rotate((float)(mirror.angle*M_PI/180.0f),glm::vec3(0,0,1));
+    Scene_Add(scene,-1,place,SHAPE_RECT,glm::vec2(mirror.a,mirror.b),mirror.color,LAYER_FRONT);
+  }
 }
-void drawBin(glm::mat4 VP,glm::vec3 translate,struct Bin *bin,glm::vec3 rotate,double angle)
+
+/* Copy the positions of the snapshot into the root transforms */
+void Scene_Sync(struct Scene *scene,const struct Sim_Snapshot *snap)
 {
-  glm::mat4 MVP;	// MVP = Projection * View * Model
-  glm::mat4 translateRectangle = glm::translate(translate);
-  Matrices.model = glm::mat4(1.0f);
-  Matrices.model *= (translateRectangle);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(bin->rect.rect);
-  Matrices.model = glm::mat4(1.0f);
-  /* Render your scene */
-  glm::mat4 translateCircle = glm::translate (translate); // glTranslatef
-  glm::mat4 rotateCircle = glm::rotate((float)(angle*M_PI/180.0f),rotate);  // rotate about vector (1,0,0)
-  Matrices.model *= translateCircle*rotateCircle;
-  MVP = VP * Matrices.model; // MVP = p * V * M
-  //  Don't change unless you are sure!!
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(bin->top.circle);
-  Matrices.model = glm::mat4(1.0f);
-  translateCircle*=glm::translate(glm::vec3(0,-bin->bin_height,0));
-  rotateCircle = glm::rotate((float)(-angle*M_PI/180.0f), rotate);
-  Matrices.model*=translateCircle*rotateCircle;
-  MVP = VP * Matrices.model; // MVP = p * V * M
-  //  Don't change unless you are sure!!
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(bin->bottom.circle);
+  const struct Sim_Gun &g=snap->gun;
+  scene->local[gun_entity]=glm::translate(glm::vec3(g.x_pos,g.y_pos,0));
+  scene->local[barrel_entity]=glm::translate(glm::vec3(-g.rect1.a/2,-g.rect1.b/2,0))
+    *glm::rotate((float)(g.rot_angle*M_PI/180.0f),glm::vec3(0,0,1));
+  for(int i=0;i<2;i++)
+    scene->local[bin_entity[i]]=glm::translate(glm::vec3(snap->bin[i].x_pos,snap->bin[i].y_pos,0));
 }
 
-void drawGun(glm::mat4 VP,glm::vec3 translate,struct Gun *gun)
+/* World transforms, parents first */
+void Scene_Update(struct Scene *scene)
 {
-  glm::mat4 MVP;	// MVP = Projection * View * Model
-  glm::mat4 move=glm::translate(glm::vec3(-gun->rect1.a/2,-gun->rect1.b/2,0));
-  glm::mat4 rotate=glm::rotate((float)(gun->rot_angle*M_PI/180.0f),glm::vec3(0,0,1));
-  move=move*rotate*glm::translate(glm::vec3(gun->rect1.a/2,gun->rect1.b/2,0));
-  Matrices.model = glm::mat4(1.0f);
-  glm::mat4 translateRectangle = glm::translate(translate);
-  Matrices.model *= (translateRectangle)*move;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(gun->rect1.rect);
-
-  Matrices.model = glm::mat4(1.0f);
-  move = glm::translate(glm::vec3(gun->rect1.a/2+gun->rect2.a/2,-gun->rect1.b/2+gun->rect2.b/2, 0));
-  move = move * glm::translate(glm::vec3(-gun->rect1.a-gun->rect2.a/2,-gun->rect2.b/2,0));
-  move = move * rotate * glm::translate(glm::vec3(gun->rect1.a+gun->rect2.a/2,gun->rect2.b/2,0));
-  Matrices.model *= (translateRectangle)*move;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(gun->rect2.rect);
-
-  Matrices.model = glm::mat4(1.0f);
-  move = glm::translate(glm::vec3(gun->rect1.a/2+gun->rect2.a,-gun->rect1.a/2, 0));
-  move = move * glm::translate(glm::vec3(-gun->rect1.a-gun->rect2.a,0,0));
-  move = move * rotate * glm::translate(glm::vec3(gun->rect1.a+gun->rect2.a,0,0));
-  Matrices.model *= translateRectangle*move;
-  MVP = VP * Matrices.model; // MVP = p * V * M
-  //  Don't change unless you are sure!!
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(gun->circle1.circle);
-
-  Matrices.model = glm::mat4(1.0f);
-  Matrices.model *= (translateRectangle)*glm::translate(glm::vec3(-gun->rect1.a/2,-gun->rect1.b/2,0));
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(gun->circle2.circle);
+  for(size_t e=0;e<scene->parent.size();e++)
+  {
+    int p=scene->parent[e];
+    scene->world[e]=p<0 ? scene->local[e] : scene->world[p]*scene->local[e];
+  }
+}
 
+void Scene_Draw(const struct Scene *scene,glm::mat4 VP,int layer)
+{
+  glm::mat4 MVP;	// MVP = Projection * View * Model
+  for(size_t e=0;e<scene->parent.size();e++)
+  {
+    if(scene->layer[e]!=layer || !scene->visible[e] || !scene->mesh[e])
+      continue;
+    MVP = VP * scene->world[e] * glm::scale(glm::vec3(scene->size[e],1));
+    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    setColor(scene->color[e]);
+    if(scene->shape[e]==SHAPE_CIRCLE)
+      draw3DObject(Circle_Mesh(max(scene->size[e].x,scene->size[e].y)));
+    else
+      draw3DObject(scene->mesh[e]);
+  }
 }
-void drawRectangle(glm::mat4 VP,glm::vec3 translate,VAO ** rectangle,double angle)
+void drawRectangle(glm::mat4 VP,glm::vec3 translate,glm::vec2 size,int color,double angle)
 {
   glm::mat4 MVP;	// MVP = Projection * View * Model
   Matrices.model = glm::mat4(1.0f);
   glm::mat4 translateRectangle = glm::translate(translate);
   glm::mat4 rotateRectangle = glm::rotate((float)((angle)*M_PI/180.0f), glm::vec3(0,0,1) );
-  Matrices.model *= translateRectangle*rotateRectangle;
+  Matrices.model *= translateRectangle*rotateRectangle*glm::scale(glm::vec3(size,1));
   MVP = VP * Matrices.model;
   glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+  setColor(color);
   // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(*rectangle);
+  draw3DObject(rect_mesh);
 }
-void drawCircle(glm::mat4 VP,glm::vec3 translate,VAO **circle,glm::vec3 rotate,double angle)
+void drawCircle(glm::mat4 VP,glm::vec3 translate,glm::vec2 size,int color,glm::vec3 rotate,double angle)
 {
   glm::mat4 MVP;	// MVP = Projection * View * Model
   Matrices.model = glm::mat4(1.0f);
   /* Render your scene */
   glm::mat4 translateCircle = glm::translate (translate); // glTranslatef
   glm::mat4 rotateCircle = glm::rotate((float)(angle*M_PI/180.0f), rotate );  // rotate about vector (1,0,0)
-  glm::mat4 CircleTransform = translateCircle * rotateCircle;
+  glm::mat4 CircleTransform = translateCircle * rotateCircle * glm::scale(glm::vec3(size,1));
   //glm::mat4 CircleTransform = translateCircle;
   Matrices.model *= CircleTransform;
   MVP = VP * Matrices.model; // MVP = p * V * M
   //  Don't change unless you are sure!!
   glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+  setColor(color);
   // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(*circle);
+  draw3DObject(Circle_Mesh(max(size.x,size.y)));
+}
+/* Bricks and bullets are each one instanced draw: the snapshot is turned
+   into Instance records and uploaded once per frame */
+void setInstanceColor(struct Instance &instance,int c)
+{
+  for(int k=0;k<3;k++)
+    instance.color[k]=palette[c][k]*255;
+  instance.color[3]=255;
 }
 void drawBricks(glm::mat4 VP)
 {
-  int count=bricks.bricks_count,pointer=bricks.pointer,j;
-  for(int i=0;i<count;i++)
+  int n=view->brick_color.size();
+  instances.resize(n);
+  for(int j=0;j<n;j++)
   {
-    j=(pointer+i)%100;
-    if(bricks.brick[j].y_pos>4)
-    {
-      bricks.pointer=(bricks.pointer+1)%100;
-      bricks.bricks_count--;
-    }
-    if(bricks.brick[j].color!=-1)
-    drawRectangle(VP,glm::vec3(bricks.brick[j].x_pos, bricks.brick[j].y_pos, 0.0f),&bricks.brick[j].rect,0);
+    struct Instance &brick=instances[j];
+    brick.x=view->brick_x[j];brick.y=view->brick_y[j];
+    brick.c=1;brick.s=0;
+    brick.w=0.2;brick.h=0.4;
+    setInstanceColor(brick,view->brick_color[j]);
   }
+  streamInstances(brick_instances,instances.data(),n);
+  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &VP[0][0]);
+  drawInstanced3DObject(brick_instances);
 }
 void drawBullets(glm::mat4 VP)
 {
-  int count=bullets.count,pointer=bullets.pointer,j;
-  glm::mat4 MVP;	// MVP = Projection * View * Model
-  for(int i=0;i<count;i++)
+  int n=view->bullet_x.size();
+  instances.resize(n);
+  for(int j=0;j<n;j++)
   {
-    j=(pointer+i)%10;
-    if(bullets.bullet[j].y_pos<-4||bullets.bullet[j].y_pos>4||bullets.bullet[j].x_pos>4||bullets.bullet[j].x_pos<-4)
-    {
-      bullets.pointer=(bullets.pointer+1)%10;
-      bullets.count--;
-    }
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 rotateRectangle = glm::rotate((float)((90+bullets.bullet[j].angle)*M_PI/180.0f), glm::vec3(0,0,1) );
-    glm::mat4 translateRectangle = glm::translate(glm::vec3(bullets.bullet[j].x_pos,bullets.bullet[j].y_pos, 0.0f));
-    Matrices.model *= translateRectangle*rotateRectangle;//translateRectangle*translateRectangle1*rotateRectangle;
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    // draw3DObject draws the VAO given to it using current MVP matrix
-    draw3DObject(bullets.bullet[j].rect);
+    // rotated by 90 degrees plus the bullet direction, taken from (dx,dy) directly
+    struct Instance &bullet=instances[j];
+    bullet.x=view->bullet_x[j];bullet.y=view->bullet_y[j];
+    bullet.c=-view->bullet_dy[j];bullet.s=view->bullet_dx[j];
+    bullet.w=view->gun.rect2.b/3;bullet.h=BULLET_LENGTH;
+    setInstanceColor(bullet,3);
   }
+  streamInstances(bullet_instances,instances.data(),n);
+  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &VP[0][0]);
+  drawInstanced3DObject(bullet_instances);
 }
-void drawMirror(glm::mat4 VP)
-{
-  for(int i=0;i<3;i++)
-    drawRectangle(VP,glm::vec3(mirror[i].rect.x_pos, mirror[i].rect.y_pos, 0.0f),&mirror[i].rect.rect,mirror[i].rect.angle);
-}
-void bin_collection(struct Bin *bin)
+#define SCORE_DIGITS 10
+/* The score is one instanced draw of seven-segment digits, ones first,
+   right to left. Its instances are rebuilt only when the score changes */
+void drawScore(glm::mat4 VP)
 {
-  int j;
-  for(int i=0;i<bricks.bricks_count;i++)
-  {
-    j=(i+bricks.pointer)%100;
-    if(bricks.brick[j].color!=-1)
-    {
-      if(bricks.brick[j].y_pos<= bin->y_pos&&bricks.brick[j].y_pos-bricks.brick[j].b>= bin->y_pos-bin->bin_height)
-      if(bricks.brick[j].x_pos-bricks.brick[j].a/2>=bin->x_pos-bin->bin_width/2
-        && bricks.brick[j].x_pos+bricks.brick[j].a/2<=bin->x_pos+bin->bin_width/2)
-        {
-          if(bricks.brick[j].color==bin->rect.color)
-          {
-            Score+=1;
-          }
-          if(bricks.brick[j].color==3)
-          {
-            cout<<"GAME OVER"<<endl;
-            cout << "Final Score is "<<Score<<endl;
-            keyboardChar (window,'Q');
-          }
-        bricks.brick[j].color=-1;
-      }
-      }
-    }
-  }
-  void reflection(struct Mirror *mirror)
-  {
-    double x1=mirror->rect.x_pos-mirror->rect.a/2*cos((mirror->rect.angle)*M_PI/180.0f);
-    double y1=mirror->rect.y_pos-mirror->rect.a/2*sin((mirror->rect.angle)*M_PI/180.0f);
-    double x2=mirror->rect.x_pos+mirror->rect.a/2*cos((mirror->rect.angle)*M_PI/180.0f);
-    double y2=mirror->rect.y_pos+mirror->rect.a/2*sin((mirror->rect.angle)*M_PI/180.0f);
-    for(int i=0;i<bullets.count;i++)
-    {
-      int j=(i+bullets.pointer)%10;
-      double x3=bullets.bullet[j].x_pos,y3=bullets.bullet[j].y_pos;
-      double x4=x3+bullets.bullet[j].b*cos((bullets.bullet[j].angle)*M_PI/180.0f);
-      double y4=y3+bullets.bullet[j].b*sin((bullets.bullet[j].angle)*M_PI/180.0f);
-      double check1=check(x1,y1,x2,y2,x3,y3);
-      double check2=check(x1,y1,x2,y2,x4,y4);
-      double check3=check(x3,y3,x4,y4,x1,y1);
-      double check4=check(x3,y3,x4,y4,x2,y2);
-      if(check1*check2<=0 && check3*check4<=0)
-      {
-        bullets.bullet[j].angle=2*mirror->rect.angle-bullets.bullet[j].angle;
-        bullets.bullet[j].x_pos=x4;//bullets.bullet[j].b*cos((bullets.bullet[j].angle)*M_PI/180.0f);
-        bullets.bullet[j].y_pos=y4;//bullets.bullet[j].b*sin((bullets.bullet[j].angle)*M_PI/180.0f);
-      }
-    }
-  }
-  void collision()
+  // bit i set: segment i lit (top, middle, bottom, upper left, upper right, lower left, lower right)
+  static const int segment_mask[10]={125,80,55,87,90,79,111,81,127,95};
+  static const float segment_x[7]={0,0,0,-0.2,0.2,-0.2,0.2};
+  static const float segment_y[7]={0,-0.4,-0.8,0,0,-0.4,-0.4};
+  if(view->Score!=score_shown)
   {
-    bin_collection(&bin[0]);
-    bin_collection(&bin[1]);
-    for(int i=0;i<bullets.count;i++)
-    {
-      for(int j=0;j<bricks.bricks_count;j++)
-      {
-        int t1=(bricks.pointer+j)%100;
-        int t2=(bullets.pointer+i)%10;
-        double x1=bricks.brick[t1].x_pos,y1=bricks.brick[t1].y_pos;//+0.1*bricks.brick[t1].b;
-        double x2=bricks.brick[t1].x_pos,y2=bricks.brick[t1].y_pos-1*bricks.brick[t1].b;
-        double x3=bullets.bullet[t2].x_pos-0.1*bullets.bullet[t2].b*cos((bullets.bullet[j].angle)*M_PI/180.0f);
-        double y3=bullets.bullet[t2].y_pos-0.1*bullets.bullet[t2].b*sin((bullets.bullet[j].angle)*M_PI/180.0f);
-        double x4=bullets.bullet[t2].x_pos+1.1*bullets.bullet[t2].b*cos((bullets.bullet[j].angle)*M_PI/180.0f);
-        double y4=bullets.bullet[t2].y_pos+1.1*bullets.bullet[t2].b*sin((bullets.bullet[j].angle)*M_PI/180.0f);
-        double check4=check(x3,y3,x4,y4,x2,y2);
-        double check1=check(x1,y1,x2,y2,x3,y3);
-        double check2=check(x1,y1,x2,y2,x4,y4);
-        double check3=check(x3,y3,x4,y4,x1,y1);
-
-        if(check1*check2<=0 && check3*check4<=0)
+    score_shown=view->Score;
+    instances.clear();
+    // a score of 0 shows no digits
+    int score=score_shown;
+    for(int d=0;d<SCORE_DIGITS && score!=0;d++,score/=10)
+      for(int i=0;i<7;i++)
+        if(segment_mask[score%10]>>i&1)
         {
-          if(bricks.brick[t1].color==3)
-            Score++;
-          bricks.brick[t1].color=-1;
+          struct Instance segment;
+          segment.x=3.5-0.6*(d+1)+segment_x[i];segment.y=3.8+segment_y[i];
+          segment.c=1;segment.s=0;
+          segment.w=i<3 ? 0.4 : 0.1;segment.h=i<3 ? 0.1 : 0.4;
+          setInstanceColor(segment,2);
+          instances.push_back(segment);
         }
-      }
-      bullets.bullet[(bullets.pointer+i)%10].x_pos+=0.15*cos(bullets.bullet[(bullets.pointer+i)%10].angle*M_PI/180.0f);
-      bullets.bullet[(bullets.pointer+i)%10].y_pos+=0.15*sin(bullets.bullet[(bullets.pointer+i)%10].angle*M_PI/180.0f);
-    }
-    reflection(&mirror[0]);
-    reflection(&mirror[1]);
-    reflection(&mirror[2]);
-
-    current_time = glfwGetTime(); // Time in seconds
-    if ((current_time - last_update_time) >= 0.01) { // atleast 0.01s elapsed since last frame
-
-      for(int i=0;i<bricks.bricks_count;i++)
-      bricks.brick[(bricks.pointer+i)%100].y_pos-=Speed_of_Brick;
-      // do something every 0.5 seconds ..
-      last_update_time = current_time;
-    }
-
-    if ((current_time - last_update_time1) >= 1) {
-      CreateBrick();
-      last_update_time1 = current_time;
-    }
+    storeInstances(score_instances,instances.data(),instances.size());
   }
-  void Create_Seven_Segment()
+  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &VP[0][0]);
+  drawInstanced3DObject(score_instances);
+}
+#define AIM_POINTS 16        // muzzle, up to 14 bounces, end
+#define AIM_LENGTH 16.0f
+/* Predicted path of the next shot: towards the cursor while aiming, else
+   along the gun. The mirrors are fixed while the game runs, so the path is
+   traced on this thread against the live game's BVH */
+void drawAimPath(glm::mat4 VP)
+{
+  float x[AIM_POINTS],y[AIM_POINTS];
+  GLfloat vertex_buffer_data[3*AIM_POINTS];
+  int n=Sim_Trace_Shot(&game,&view->gun,aiming ? aim_angle : view->gun.rot_angle,AIM_LENGTH,x,y,AIM_POINTS);
+  for(int i=0;i<n;i++)
   {
-    for(int i=0;i<3;i++){
-      display.segment[i].a=0.4;
-      display.segment[i].b=0.1;
-    }
-    for(int i=3;i<7;i++){
-      display.segment[i].b=0.4;
-      display.segment[i].a=0.1;
-    }
-    display.segment[0].x_pos=0;display.segment[0].y_pos=0;
-    display.segment[1].x_pos=0;display.segment[1].y_pos=-0.4;
-    display.segment[2].x_pos=0;display.segment[2].y_pos=-0.8;
-    display.segment[3].x_pos=-0.2;display.segment[3].y_pos=0;
-    display.segment[4].x_pos=0.2;display.segment[4].y_pos=0;
-    display.segment[5].x_pos=-0.2;display.segment[5].y_pos=-0.4;
-    display.segment[6].x_pos=0.2;display.segment[6].y_pos=-0.4;
-    for(int i=0;i<7;i++)
-    {
-      display.segment[i].x_pos+=3.5;
-      display.segment[i].y_pos+=3.8;
-    }
-    for(int i=0;i<7;i++)
-      CreateRectangle(display.segment[i].a,display.segment[i].b,2,&display.segment[i].rect);
-  }
-  void drawSevenSegment(glm::mat4 VP)
-  {
-    int temp=Score,digit;
-  while(temp!=0)
-    {
-      for(int i=0;i<7;i++)
-      {
-        display.segment[i].x_pos-=0.6;
-        //display.segment[i].y_pos+=3.8;
-      }
-    digit=temp%10;
-     temp=temp/10;
-    if(digit!=1&&digit!=4)
-      drawRectangle(VP,glm::vec3(display.segment[0].x_pos,display.segment[0].y_pos, 0),&display.segment[0].rect,0);
-    if(digit!=1&&digit!=7&&digit!=0)
-      drawRectangle(VP,glm::vec3(display.segment[1].x_pos,display.segment[1].y_pos, 0),&display.segment[1].rect,0);
-    if(digit!=1&&digit!=7&&digit!=4)
-      drawRectangle(VP,glm::vec3(display.segment[2].x_pos,display.segment[2].y_pos, 0),&display.segment[2].rect,0);
-    if(digit!=1&&digit!=2&&digit!=3&&digit!=7)
-      drawRectangle(VP,glm::vec3(display.segment[3].x_pos,display.segment[3].y_pos, 0),&display.segment[3].rect,0);
-    if(digit!=5&&digit!=6)
-      drawRectangle(VP,glm::vec3(display.segment[4].x_pos,display.segment[4].y_pos, 0),&display.segment[4].rect,0);
-    if(digit==0||digit==2||digit==6||digit==8)
-      drawRectangle(VP,glm::vec3(display.segment[5].x_pos,display.segment[5].y_pos, 0),&display.segment[5].rect,0);
-    if(digit!=2)
-      drawRectangle(VP,glm::vec3(display.segment[6].x_pos,display.segment[6].y_pos, 0),&display.segment[6].rect,0);
-    }
-
+    vertex_buffer_data[3*i]=x[i];
+    vertex_buffer_data[3*i+1]=y[i];
+    vertex_buffer_data[3*i+2]=0;
   }
+  streamVertices(aim_path,vertex_buffer_data,n);
+  glm::mat4 MVP = VP;
+  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+  glUniform3f(Matrices.ColorID, 0.5, 0.5, 0.5);
+  draw3DObject(aim_path);
+}
   void mouse_func(GLFWwindow* window)
   {
     if(mouse_left)
@@ -939,27 +1198,33 @@ void bin_collection(struct Bin *bin)
       glfwGetCursorPos(window,&x_pos,&y_pos);
       x_pos=8*((x_pos-fbwidth/2)/fbwidth*1.0);
       y_pos=-8*((y_pos-fbheight/2)/fbheight*1.0);
-      current_time=glfwGetTime();
-
       if(bin0)
-        bin[0].x_pos=x_pos;
+        Input_Push(&input_ring,SIM_INPUT_SET_BIN,0,x_pos,0);
       else if(bin1)
-        bin[1].x_pos=x_pos;
+        Input_Push(&input_ring,SIM_INPUT_SET_BIN,1,x_pos,0);
       else if(gun0)
-      gun.y_pos=y_pos;
-      else if(current_time- time_to_hit_space>=0.5)
-        {
-        //cout << atan((y_pos-gun.y_pos)/(x_pos-gun.x_pos))<< endl;
-        gun.rot_angle=atan((y_pos-gun.y_pos)/(x_pos-gun.x_pos))/DEG2RAD;
-        CreateBullet();
-        time_to_hit_space=current_time;
+      Input_Push(&input_ring,SIM_INPUT_SET_GUN,0,y_pos,0);
+      else
+      {
+        Input_Push(&input_ring,SIM_INPUT_AIM,0,x_pos,y_pos);
+        aim_angle=atan((y_pos-view->gun.y_pos)/(x_pos-view->gun.x_pos))*180/M_PI;
+        aiming=true;
       }
 
     }
   }
   void draw ()
   {
-    collision();
+    double t=Profile_Start(draw_profile);
+    view=&snapshots.Read();
+    if(view->replay_done)
+      keyboardChar (window,'Q');
+    if(view->game_over)
+    {
+      cout<<"GAME OVER"<<endl;
+      cout << "Final Score is "<<view->Score<<endl;
+      keyboardChar (window,'Q');
+    }
     // clear the color and depth in the frame buffer
     glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     // use the loaded shader program
@@ -992,16 +1257,23 @@ void bin_collection(struct Bin *bin)
     //drawRectangle(VP,glm::vec3(0.0f, 0.0f, 0.0f),&bin[0].rect,0);
     //drawCircle(VP,glm::vec3(0.8f, -0.2f, 0.0f),&circle,glm::vec3(0,1,0),70);
     //drawRectangle(VP,glm::vec3(mirror[0].rect.x_pos, mirror[0].rect.y_pos, 0.0f),&mirror[0].rect.rect,mirror[0].rect.angle);
-    drawGun(VP,glm::vec3(gun.x_pos,gun.y_pos, 0.0f),&gun);
-    //drawRectangle(VP,glm::vec3(0.5f,-0.1f, 0.0f),&rectangle1,0);
-    Create_Seven_Segment();
-    drawSevenSegment(VP);
-    //drawCircle(VP,glm::vec3(0.0f, -1.0f, 0.0f),&bin[0].bottom,70);
+    Scene_Sync(&scene,view);
+    Scene_Update(&scene);
+    Profile_Lap(draw_profile,DRAW_SCENE,&t);
+    Scene_Draw(&scene,VP,LAYER_BACK);
+    Profile_Lap(draw_profile,DRAW_BACK,&t);
+    drawScore(VP);
+    Profile_Lap(draw_profile,DRAW_SCORE,&t);
     drawBricks(VP);
-    drawBin(VP,glm::vec3(bin[0].x_pos, bin[0].y_pos, 0.0f),&bin[0],glm::vec3(1,0,0),-70);
-    drawBin(VP,glm::vec3(bin[1].x_pos, bin[1].y_pos, 0.0f),&bin[1],glm::vec3(1,0,0),-70);
+    Profile_Lap(draw_profile,DRAW_BRICKS,&t);
+    Scene_Draw(&scene,VP,LAYER_BINS);
+    Profile_Lap(draw_profile,DRAW_BINS,&t);
     drawBullets(VP);
-    drawMirror(VP);
+    Profile_Lap(draw_profile,DRAW_BULLETS,&t);
+    drawAimPath(VP);
+    Profile_Lap(draw_profile,DRAW_AIM,&t);
+    Scene_Draw(&scene,VP,LAYER_FRONT);
+    Profile_Lap(draw_profile,DRAW_FRONT,&t);
 
 
     // For each model you render, since the MVP will be different (at least the M part)
@@ -1074,16 +1346,17 @@ void bin_collection(struct Bin *bin)
     /* Objects should be created before any other gl function and shaders */
     // Create the models
     //createTriangle (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
-    CreateBin(&bin[0],1);
-    CreateBin(&bin[1],0);
-    CreateGun(&gun,3);
-    CreateMirror();
-    Create_Seven_Segment();
+    createStreamBuffer(&stream,STREAM_REGION_SIZE);
+    CreateMeshes();
+    aim_path=createStreamObject(GL_LINE_STRIP,AIM_POINTS);
+    CreateScene(&scene);
     //CreateRectangle(0.2,0.4,3,&rectangle);
     // Create and compile our GLSL program from the shaders
     programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
     // Get a handle for our "MVP" uniform
     Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+    Matrices.ColorID = glGetUniformLocation(programID, "Color");
+    Matrices.InstancedID = glGetUniformLocation(programID, "Instanced");
 
     reshapeWindow (window, width, height);
 
@@ -1100,41 +1373,305 @@ void bin_collection(struct Bin *bin)
     cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
   }
 
+  /* Start a headless game; the bot's input goes through bot_ring stamped at
+     time 0, so it is applied on the next tick like window input would be */
+  struct Sim_Input_Ring bot_ring;
+  void StartHeadlessGame(unsigned int seed,double dt,struct Thread_Pool *pool,struct Sim_Rewind *rewind,struct Sim_Profile *profile)
+  {
+    Sim_Init(&game,seed);
+    Sim_Set_Tick(&game,dt);
+    Sim_Copy_Mirrors(&game,&level);
+    game.threads=pool;
+    Input_Ring_Init(&bot_ring);
+    game.input=&bot_ring;
+    game.input_epoch=0;
+    if(rewind)
+      Rewind_Clear(rewind);
+    game.rewind=rewind;
+    game.profile=profile;
+  }
+
+  /* Step the simulation without a window as fast as possible and report steps/sec.
+     A simple bot keeps firing at random angles so collisions are exercised;
+     a lost game is restarted with the next seed. With stress_bricks or
+     stress_bullets set the game never ends: bricks and bullets are topped up
+     to stress_bricks and stress_bullets each step, as they fall out or hit.
+     With record set the first game is written there as a replay. With
+     rewind_seconds set every tick is kept for rewind; its cost is the rewind
+     phase of the profile.
+     With profile set the phases of every tick are timed, reported and
+     written there. */
+  int RunHeadless(long frames,unsigned int seed,int stress_bricks,int stress_bullets,double dt,int threads,const char *record,double rewind_seconds,const char *profile)
+  {
+    long games=1,total_score=0;
+    if(record && (stress_bricks>0||stress_bullets>0))
+    {
+      cerr << "--record cannot be used with --bricks or --bullets" << endl;
+      return 1;
+    }
+    struct Thread_Pool *pool=threads>1 ? Thread_Pool_Create(threads) : NULL;
+    unsigned int bot_rng=Sim_Seed(seed,1);
+    struct Sim_Rewind *rewind=NULL;
+    if(rewind_seconds>0)
+    {
+      Rewind_Init(&rewind_ring,(int)(rewind_seconds/dt+0.5),REWIND_MAX_BRICKS+stress_bricks,REWIND_MAX_BULLETS+stress_bullets);
+      rewind=&rewind_ring;
+    }
+    if(profile)
+      Profile_Init(&sim_profile,"sim",sim_phase_name,SIM_PHASES);
+    StartHeadlessGame(seed,dt,pool,rewind,profile ? &sim_profile : NULL);
+    game.endless=stress_bricks>0||stress_bullets>0;
+    Sim_Populate(&game,stress_bricks);
+    if(record)
+      game.recorder=Recorder_Create(&game,seed);
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    for(long frame=0;frame<frames;frame++)
+    {
+      if(Sim_Can_Fire(&game))
+      {
+        Input_Push_At(&bot_ring,0,SIM_INPUT_SET_ANGLE,0,(int)(Sim_Rand(&bot_rng)%161)-80,0);
+        Input_Push_At(&bot_ring,0,SIM_INPUT_FIRE,0,0,0);
+      }
+      if(game.bricks.pool.count<stress_bricks)
+        Sim_Populate(&game,stress_bricks-game.bricks.pool.count);
+      while(game.bullets.pool.count<stress_bullets)
+      {
+        double angle=(Sim_Rand(&bot_rng)%360)*M_PI/180;
+        float x_pos=((int)(Sim_Rand(&bot_rng)%8001)-4000)/1000.0;
+        float y_pos=((int)(Sim_Rand(&bot_rng)%8001)-4000)/1000.0;
+        Sim_Add_Bullet(&game,x_pos,y_pos,cos(angle),sin(angle));
+      }
+      Sim_Step(&game);
+      if(game.game_over && !game.endless)
+      {
+        total_score+=game.Score;
+        if(game.recorder)
+          Recorder_Close(game.recorder,&game,record);
+        StartHeadlessGame(seed+games,dt,pool,rewind,game.profile);
+        games++;
+      }
+    }
+    if(game.recorder)
+      Recorder_Close(game.recorder,&game,record);
+    game.recorder=NULL;
+    total_score+=game.Score;
+    double seconds=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    cout << "Kernel: " << Segment_Hits_Name() << " Threads: " << Thread_Pool_Size(pool) << endl;
+    cout << "Steps: " << frames << endl;
+    cout << "Time: " << seconds << " s" << endl;
+    cout << "Steps/sec: " << (seconds>0 ? frames/seconds : 0) << endl;
+    cout << "Games: " << games << " Total score: " << total_score << endl;
+    cout << "Bricks: " << game.bricks.pool.count << " Bullets: " << game.bullets.pool.count << endl;
+    if(rewind)
+      Rewind_Report(rewind);
+    if(profile)
+    {
+      const struct Sim_Profile *profiles[1]={&sim_profile};
+      Profile_Report(&sim_profile);
+      Profile_Write(profiles,1,profile);
+    }
+    game.threads=NULL;
+    game.rewind=NULL;
+    game.profile=NULL;
+    Thread_Pool_Destroy(pool);
+    return 0;
+  }
+
+  /* Play a recorded game back as fast as possible and check that it ends in
+     exactly the recorded state */
+  int RunReplay(struct Sim_Replay *replay,int threads)
+  {
+    struct Thread_Pool *pool=threads>1 ? Thread_Pool_Create(threads) : NULL;
+    Replay_Start(replay,&game);
+    game.threads=pool;
+    Rewind_Init(&rewind_ring,(int)(REWIND_SECONDS/game.dt+0.5),REWIND_MAX_BRICKS,REWIND_MAX_BULLETS);
+    game.rewind=&rewind_ring;
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    while(!Replay_Done(replay,&game) && !game.game_over)
+      Sim_Step(&game);
+    double seconds=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    cout << "Steps: " << game.tick << endl;
+    cout << "Time: " << seconds << " s" << endl;
+    cout << "Steps/sec: " << (seconds>0 ? game.tick/seconds : 0) << endl;
+    bool match=Replay_Check(replay,&game);
+    game.threads=NULL;
+    game.replay=NULL;
+    game.rewind=NULL;
+    Thread_Pool_Destroy(pool);
+    Replay_Close(replay);
+    return match ? 0 : 1;
+  }
+
+  /* Step instances games at once through Sim_Batch with the random-aim bot,
+     on the mirrors of level; an instance that loses starts over with a new
+     seed */
+  int RunBatch(long frames,unsigned int seed,int instances,double dt,const struct Game *level)
+  {
+    static struct Sim_Batch batch;
+    long games=instances,total_score=0;
+    Batch_Init(&batch,instances,seed);
+    Batch_Set_Tick(&batch,dt);
+    if(!Batch_Set_Mirrors(&batch,level))
+    {
+      cerr << "--batch takes at most " << BATCH_MIRRORS << " mirrors, the level has " << level->mirror_count << endl;
+      return 1;
+    }
+    batch.bot=true;
+    for(int i=0;i<instances;i++)
+      Batch_Reset(&batch,i,seed);
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    for(long frame=0;frame<frames;frame++)
+    {
+      Batch_Step(&batch);
+      for(int i=0;i<instances;i++)
+        if(batch.over[i])
+        {
+          total_score+=batch.score[i];
+          Batch_Reset(&batch,i,seed+games++);
+        }
+    }
+    for(int i=0;i<instances;i++)
+      total_score+=batch.score[i];
+    double seconds=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    cout << "Instances: " << instances << " Steps: " << frames << endl;
+    cout << "Time: " << seconds << " s" << endl;
+    cout << "Game steps/sec: " << (seconds>0 ? frames*(double)instances/seconds : 0) << endl;
+    cout << "Games: " << games << " Total score: " << total_score << endl;
+    return 0;
+  }
+
   int main (int argc, char** argv)
   {
     int width = 600;
     int height = 600;
+    bool headless=false;
+    long frames=100000;
+    unsigned int seed=time(NULL);
+    int stress_bricks=0,stress_bullets=0;
+    double dt=SIM_DT;
+    int threads=1;
+    int batch=0;
+    double rewind_seconds=0;
+    const char *level_path=NULL;
+    int mirrors=0;
+    for(int i=1;i<argc;i++)
+    {
+      if(!strcmp(argv[i],"--headless"))
+        headless=true;
+      else if(!strcmp(argv[i],"--frames")&&i+1<argc)
+        frames=atol(argv[++i]);
+      else if(!strcmp(argv[i],"--seed")&&i+1<argc)
+        seed=strtoul(argv[++i],NULL,10);
+      else if(!strcmp(argv[i],"--bricks")&&i+1<argc)
+        stress_bricks=atoi(argv[++i]);
+      else if(!strcmp(argv[i],"--bullets")&&i+1<argc)
+        stress_bullets=atoi(argv[++i]);
+      else if(!strcmp(argv[i],"--record")&&i+1<argc)
+        record_path=argv[++i];
+      else if(!strcmp(argv[i],"--replay")&&i+1<argc)
+      {
+        replay=Replay_Open(argv[++i]);
+        if(!replay)
+          return 1;
+      }
+      else if(!strcmp(argv[i],"--level")&&i+1<argc)
+        level_path=argv[++i];
+      else if(!strcmp(argv[i],"--mirrors")&&i+1<argc)
+        mirrors=atoi(argv[++i]);
+      else if(!strcmp(argv[i],"--profile")&&i+1<argc)
+        profile_path=argv[++i];
+      else if(!strcmp(argv[i],"--rewind")&&i+1<argc)
+        rewind_seconds=atof(argv[++i]);
+      else if(!strcmp(argv[i],"--batch")&&i+1<argc)
+        batch=atoi(argv[++i]);
+      else if(!strcmp(argv[i],"--threads")&&i+1<argc)
+        threads=atoi(argv[++i]);
+      else if(!strcmp(argv[i],"--tick-ms")&&i+1<argc)
+        dt=atof(argv[++i])/1000;
+      else if(!strcmp(argv[i],"--kernel")&&i+1<argc)
+      {
+        if(!Segment_Hits_Select(argv[++i]))
+          cerr << "Kernel " << argv[i] << " not available, using " << Segment_Hits_Name() << endl;
+      }
+    }
+    Sim_Init(&level,seed);
+    if(level_path && !Sim_Load_Level(&level,level_path))
+    {
+      cerr << "Cannot read level " << level_path << endl;
+      return 1;
+    }
+    if(!level_path && mirrors>0)
+      Sim_Scatter_Mirrors(&level,mirrors,seed);
+    if(headless && replay)
+      return RunReplay(replay,threads);
+    if(headless && batch>0)
+    {
+      // Sim_Batch has fixed slots and no Game: nothing else would apply
+      if(stress_bricks>0||stress_bullets>0||record_path||profile_path||rewind_seconds>0||threads>1)
+      {
+        cerr << "--batch cannot be used with --bricks, --bullets, --record, --profile, --rewind or --threads" << endl;
+        return 1;
+      }
+      return RunBatch(frames,seed,batch,dt,&level);
+    }
+    if(headless)
+      return RunHeadless(frames,seed,stress_bricks,stress_bullets,dt,threads,record_path,rewind_seconds,profile_path);
+
     fbwidth=width;
     fbheight=height;
-    srand(time(NULL));
     window = initGLFW(width, height);
-    bricks.bricks_count=0;
-    bricks.pointer=0;
-    gun.x_pos=-3.5;
-    gun.y_pos=0;
-    bin[0].x_pos=0;
-    bin[0].y_pos=-2.5;
-    bin[1].x_pos=1;
-    bin[1].y_pos=-2.5;
+    if(replay)
+    {
+      Replay_Start(replay,&game);
+      seed=replay->seed;
+    }
+    else
+    {
+      Sim_Init(&game,seed);
+      Sim_Copy_Mirrors(&game,&level);
+    }
+    if(record_path)
+      game.recorder=Recorder_Create(&game,seed);
+    Rewind_Init(&rewind_ring,(int)(REWIND_SECONDS/game.dt+0.5),REWIND_MAX_BRICKS,REWIND_MAX_BULLETS);
+    game.rewind=&rewind_ring;
+    Profile_Init(&sim_profile,"sim",sim_phase_name,SIM_PHASES);
+    Profile_Init(&render_profile,"render",draw_phase_name,DRAW_PHASES);
+    game.profile=profile_path ? &sim_profile : NULL;
+    draw_profile=profile_path ? &render_profile : NULL;
     initGL (window, width, height);
+    StartSimulation();
     /* Draw in loop */
 
     while (!glfwWindowShouldClose(window)) {
 
+      if(draw_armed)
+        draw_profile=&render_profile;
+      double frame=Profile_Start(draw_profile),t=frame;
       // OpenGL Draw commands
       mouse_func(window);
+      Profile_Lap(draw_profile,DRAW_MOUSE,&t);
       draw();
+      streamNextRegion(&stream);
 
       // Swap Frame Buffer in double buffering
+      t=Profile_Start(draw_profile);
       glfwSwapBuffers(window);
+      Profile_Lap(draw_profile,DRAW_SWAP,&t);
 
       // Poll for Keyboard and mouse events
       glfwPollEvents();
+      if(profile_request.load()==2)
+      {
+        WriteProfile(&sim_profile_copy);
+        profile_request=0;
+      }
+      Profile_Lap(draw_profile,DRAW_FRAME,&frame);
 
       // Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
 
     }
 
+    StopSimulation();
     glfwTerminate();
     //    exit(EXIT_SUCCESS);
   }
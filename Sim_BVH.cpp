@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Sim_BVH.h"
+#include "Sim_Kernel.h"
+
+// boxes are grown by this much so rounding never culls a segment the exact
+// crossing test would report (axis-aligned mirrors have flat boxes)
+#define BVH_PAD 1e-3f
+
+struct BVH_Input {
+  const float *x1,*y1,*x2,*y2;
+  std::vector<float> cx,cy;   // segment midpoints
+  std::vector<int> order;
+};
+
+static void build_node(struct Sim_BVH *bvh,struct BVH_Input &in,int n,int begin,int end)
+{
+  float min_x=INFINITY,min_y=INFINITY,max_x=-INFINITY,max_y=-INFINITY;
+  float cmin_x=INFINITY,cmin_y=INFINITY,cmax_x=-INFINITY,cmax_y=-INFINITY;
+  for(int k=begin;k<end;k++)
+  {
+    int i=in.order[k];
+    min_x=fminf(min_x,fminf(in.x1[i],in.x2[i]));max_x=fmaxf(max_x,fmaxf(in.x1[i],in.x2[i]));
+    min_y=fminf(min_y,fminf(in.y1[i],in.y2[i]));max_y=fmaxf(max_y,fmaxf(in.y1[i],in.y2[i]));
+    cmin_x=fminf(cmin_x,in.cx[i]);cmax_x=fmaxf(cmax_x,in.cx[i]);
+    cmin_y=fminf(cmin_y,in.cy[i]);cmax_y=fmaxf(cmax_y,in.cy[i]);
+  }
+  bvh->node[n].min_x=min_x-BVH_PAD;bvh->node[n].max_x=max_x+BVH_PAD;
+  bvh->node[n].min_y=min_y-BVH_PAD;bvh->node[n].max_y=max_y+BVH_PAD;
+  if(end-begin<=BVH_LEAF)
+  {
+    bvh->node[n].first=bvh->item.size();
+    bvh->node[n].count=end-begin;
+    for(int k=begin;k<end;k++)
+    {
+      int i=in.order[k];
+      bvh->item.push_back(i);
+      bvh->x1.push_back(in.x1[i]);bvh->y1.push_back(in.y1[i]);
+      bvh->x2.push_back(in.x2[i]);bvh->y2.push_back(in.y2[i]);
+    }
+    return;
+  }
+  // median split of the midpoints along the longer side
+  const std::vector<float> &c=cmax_x-cmin_x>=cmax_y-cmin_y ? in.cx : in.cy;
+  int mid=(begin+end)/2;
+  std::nth_element(in.order.begin()+begin,in.order.begin()+mid,in.order.begin()+end,
+    [&c](int a,int b) { return c[a]<c[b] || (c[a]==c[b] && a<b); });
+  int left=bvh->node.size();
+  bvh->node.resize(left+2);
+  bvh->node[n].first=left;
+  bvh->node[n].count=0;
+  build_node(bvh,in,left,begin,mid);
+  build_node(bvh,in,left+1,mid,end);
+}
+
+void BVH_Build(struct Sim_BVH *bvh,const float *x1,const float *y1,const float *x2,const float *y2,int n)
+{
+  struct BVH_Input in;
+  in.x1=x1;in.y1=y1;in.x2=x2;in.y2=y2;
+  in.cx.resize(n);in.cy.resize(n);in.order.resize(n);
+  for(int i=0;i<n;i++)
+  {
+    in.cx[i]=(x1[i]+x2[i])/2;
+    in.cy[i]=(y1[i]+y2[i])/2;
+    in.order[i]=i;
+  }
+  bvh->node.clear();
+  bvh->item.clear();
+  bvh->x1.clear();bvh->y1.clear();bvh->x2.clear();bvh->y2.clear();
+  if(n==0)
+    return;
+  bvh->node.resize(1);
+  build_node(bvh,in,0,0,n);
+}
+
+/* Does the leg enter the box within distance limit (slab test) */
+static bool leg_enters(const struct Sim_BVH_Node &node,float hx,float hy,float dx,float dy,float limit)
+{
+  float t0=0,t1=limit;
+  if(dx!=0)
+  {
+    float a=(node.min_x-hx)/dx,b=(node.max_x-hx)/dx;
+    t0=fmaxf(t0,fminf(a,b));t1=fminf(t1,fmaxf(a,b));
+  }
+  else if(hx<node.min_x || hx>node.max_x)
+    return false;
+  if(dy!=0)
+  {
+    float a=(node.min_y-hy)/dy,b=(node.max_y-hy)/dy;
+    t0=fmaxf(t0,fminf(a,b));t1=fminf(t1,fmaxf(a,b));
+  }
+  else if(hy<node.min_y || hy>node.max_y)
+    return false;
+  return t0<=t1;
+}
+
+int BVH_First_Hit(const struct Sim_BVH *bvh,float hx,float hy,float dx,float dy,float s,int skip,float *u)
+{
+  int stack[BVH_DEPTH],top=0,hit=-1;
+  unsigned int mask[(BVH_LEAF+31)/32];
+  if(!bvh->node.empty())
+    stack[top++]=0;
+  while(top>0)
+  {
+    const struct Sim_BVH_Node &node=bvh->node[stack[--top]];
+    if(!leg_enters(node,hx,hy,dx,dy,hit==-1 ? s : fminf(s,*u)))
+      continue;
+    if(node.count==0)
+    {
+      // visit the child nearer along the leg first so *u shrinks early
+      const struct Sim_BVH_Node &l=bvh->node[node.first],&r=bvh->node[node.first+1];
+      float dl=(l.min_x+l.max_x)*dx+(l.min_y+l.max_y)*dy,dr=(r.min_x+r.max_x)*dx+(r.min_y+r.max_y)*dy;
+      stack[top++]=dl<=dr ? node.first+1 : node.first;
+      stack[top++]=dl<=dr ? node.first : node.first+1;
+      continue;
+    }
+    int first=node.first;
+    Segment_Hits(&bvh->x1[first],&bvh->y1[first],&bvh->x2[first],&bvh->y2[first],node.count,
+      hx,hy,hx+s*dx,hy+s*dy,mask);
+    for(unsigned int m=mask[0];m;m&=m-1)
+    {
+      int k=first+__builtin_ctz(m),i=bvh->item[k];
+      float ex=bvh->x2[k]-bvh->x1[k],ey=bvh->y2[k]-bvh->y1[k];
+      float denom=dx*ey-dy*ex;
+      if(i==skip || denom==0)
+        continue;
+      float t=((bvh->x1[k]-hx)*ey-(bvh->y1[k]-hy)*ex)/denom;
+      if(hit==-1 || t<*u || (t==*u && i<hit))
+      {
+        hit=i;
+        *u=t;
+      }
+    }
+  }
+  return hit;
+}
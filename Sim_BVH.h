@@ -0,0 +1,32 @@
+#ifndef SIM_BVH_H
+#define SIM_BVH_H
+
+#include <vector>
+
+/* Bounding volume hierarchy over static segments (the mirrors), built once
+   when the level is set up. Leaves hold up to BVH_LEAF segments, copied in
+   leaf order so each leaf is tested with one Segment_Hits call; a bullet leg
+   then visits O(log n) nodes instead of testing every segment */
+#define BVH_LEAF 8
+#define BVH_DEPTH 64     // traversal stack; enough for any median split tree
+
+struct Sim_BVH_Node {
+  float min_x,min_y,max_x,max_y;
+  int first;   // leaf: first segment; inner: left child (right is first+1)
+  int count;   // segments in a leaf, 0 for an inner node
+};
+
+struct Sim_BVH {
+  std::vector<struct Sim_BVH_Node> node;   // node 0 is the root
+  std::vector<int> item;                   // original index of each segment
+  std::vector<float> x1,y1,x2,y2;          // segments in leaf order
+};
+
+void BVH_Build(struct Sim_BVH *bvh,const float *x1,const float *y1,const float *x2,const float *y2,int n);
+/* First segment crossed by the leg from (hx,hy) over s along (dx,dy),
+   skipping segment skip (original index): returns its original index and
+   the distance to it in *u, or -1. Ties go to the lower index, as in a
+   linear scan */
+int BVH_First_Hit(const struct Sim_BVH *bvh,float hx,float hy,float dx,float dy,float s,int skip,float *u);
+
+#endif
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Sim_Batch.h"
+#include "Sim_Grid.h"
+
+/* The loops over instances are written branch-free so they vectorize; on
+   x86 Linux they are also built for AVX2 and picked at load time, as
+   Segment_Hits picks its kernel. The arrays they touch never overlap, which
+   the ivdep pragmas tell the compiler so it drops its runtime alias checks */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__linux__)
+#define BATCH_TARGETS __attribute__((target_clones("avx2","default")))
+#else
+#define BATCH_TARGETS
+#endif
+
+#define BRICK_A 0.2f
+#define BRICK_B 0.4f
+#define BULLET_B 0.8f
+
+/* c ? a : b for c 0 or 1, on the bit patterns. GCC turns chains of ?:
+   back into branches, which stops the loop from vectorizing; this stays a
+   blend */
+static inline float lane_select(int c,float a,float b)
+{
+  unsigned int ua,ub,mask=0u-(unsigned int)c;
+  memcpy(&ua,&a,sizeof(ua));
+  memcpy(&ub,&b,sizeof(ub));
+  ua=(ua&mask)|(ub&~mask);
+  memcpy(&a,&ua,sizeof(a));
+  return a;
+}
+
+/* Same orientation test as Segment_Hits */
+static inline int segments_cross(float x1,float y1,float x2,float y2,float x3,float y3,float x4,float y4)
+{
+  float check1=(y1-y2)*(x3-x1)-(x1-x2)*(y3-y1);
+  float check2=(y1-y2)*(x4-x1)-(x1-x2)*(y4-y1);
+  float check3=(y3-y4)*(x1-x3)-(x3-x4)*(y1-y3);
+  float check4=(y3-y4)*(x2-x3)-(x3-x4)*(y2-y3);
+  return (check1*check2<=0) & (check3*check4<=0);
+}
+
+bool Batch_Set_Mirrors(struct Sim_Batch *batch,const struct Game *level)
+{
+  if(level->mirror_count>BATCH_MIRRORS)
+    return false;
+  batch->mirror_count=level->mirror_count;
+  for(int m=0;m<batch->mirror_count;m++)
+  {
+    batch->mirror_x1[m]=level->mirror_x1[m];batch->mirror_y1[m]=level->mirror_y1[m];
+    batch->mirror_x2[m]=level->mirror_x2[m];batch->mirror_y2[m]=level->mirror_y2[m];
+    batch->mirror_nx[m]=level->mirror_nx[m];batch->mirror_ny[m]=level->mirror_ny[m];
+  }
+  return true;
+}
+
+void Batch_Init(struct Sim_Batch *batch,int count,unsigned int seed)
+{
+  struct Game game;
+  Sim_Init(&game,seed);
+  batch->count=count;
+  batch->bot=false;
+  batch->bin[0]=game.bin[0];
+  batch->bin[1]=game.bin[1];
+  batch->gun=game.gun;
+  Batch_Set_Mirrors(batch,&game);
+
+  batch->rng.assign(count,1);
+  batch->tick.assign(count,0);
+  batch->score.assign(count,0);
+  batch->over.assign(count,0);
+  batch->spawn_in.assign(count,0);
+  batch->reload_in.assign(count,0);
+  batch->brick_speed.assign(count,0);
+  batch->gun_y.assign(count,0);
+  batch->aim.assign(count,0);
+  batch->bin_x[0].assign(count,0);
+  batch->bin_x[1].assign(count,0);
+  batch->brick_x.assign(BATCH_BRICKS*count,0);
+  batch->brick_y.assign(BATCH_BRICKS*count,0);
+  batch->brick_color.assign(BATCH_BRICKS*count,-1);
+  batch->bullet_x.assign(BATCH_BULLETS*count,0);
+  batch->bullet_y.assign(BATCH_BULLETS*count,0);
+  batch->bullet_dx.assign(BATCH_BULLETS*count,0);
+  batch->bullet_dy.assign(BATCH_BULLETS*count,0);
+  batch->bullet_live.assign(BATCH_BULLETS*count,0);
+  std::vector<float> *scratch[]={&batch->hx,&batch->hy,&batch->dx,&batch->dy,&batch->s,
+    &batch->x3,&batch->y3,&batch->x4,&batch->y4};
+  for(int k=0;k<9;k++)
+    scratch[k]->assign(count,0);
+  batch->last.assign(count,0);
+  batch->active.assign(count,0);
+  batch->leg.assign(count,0);
+  batch->alive.assign(count,0);
+
+  Batch_Set_Tick(batch,SIM_DT);
+  for(int i=0;i<count;i++)
+    Batch_Reset(batch,i,seed);
+}
+
+void Batch_Set_Tick(struct Sim_Batch *batch,double dt)
+{
+  batch->dt=dt;
+  batch->spawn_ticks=(int)(BRICK_SPAWN_TIME/dt+0.5);
+  batch->reload_ticks=(int)(RELOAD_TIME/dt+0.5);
+  if(batch->spawn_ticks<1)
+    batch->spawn_ticks=1;
+  if(batch->reload_ticks<1)
+    batch->reload_ticks=1;
+}
+
+void Batch_Reset(struct Sim_Batch *batch,int i,unsigned int seed)
+{
+  const int n=batch->count;
+  batch->rng[i]=Sim_Seed(seed,i);
+  batch->tick[i]=0;
+  batch->score[i]=0;
+  batch->over[i]=0;
+  batch->spawn_in[i]=batch->spawn_ticks;
+  batch->reload_in[i]=batch->reload_ticks;
+  batch->brick_speed[i]=0.01;
+  batch->gun_y[i]=batch->gun.y_pos;
+  batch->aim[i]=batch->gun.rot_angle;
+  batch->bin_x[0][i]=batch->bin[0].x_pos;
+  batch->bin_x[1][i]=batch->bin[1].x_pos;
+  for(int j=0;j<BATCH_BRICKS;j++)
+    batch->brick_color[j*n+i]=-1;
+  for(int k=0;k<BATCH_BULLETS;k++)
+    batch->bullet_live[k*n+i]=0;
+}
+
+/* Rare per-instance events (a shot every RELOAD_TIME, a brick every
+   BRICK_SPAWN_TIME) are handled one instance at a time */
+static void fire(struct Sim_Batch *batch)
+{
+  const int n=batch->count;
+  const struct Sim_Gun &gun=batch->gun;
+  const float gun_length=gun.rect1.a+gun.rect2.a;
+  for(int i=0;i<n;i++)
+  {
+    if(!batch->alive[i] || batch->reload_in[i]>0)
+      continue;
+    batch->reload_in[i]=batch->reload_ticks;
+    if(batch->bot)
+      batch->aim[i]=(int)(Sim_Rand(&batch->rng[i])%161)-80;
+    int k=0;
+    while(k<BATCH_BULLETS && batch->bullet_live[k*n+i])
+      k++;
+    if(k==BATCH_BULLETS)
+      continue;
+    float dx=cos(batch->aim[i]*M_PI/180.0f),dy=sin(batch->aim[i]*M_PI/180.0f);
+    batch->bullet_x[k*n+i]=-gun.rect1.a/2+gun.x_pos+gun_length*dx;
+    batch->bullet_y[k*n+i]=-gun.rect1.b/2+batch->gun_y[i]+gun_length*dy;
+    batch->bullet_dx[k*n+i]=dx;
+    batch->bullet_dy[k*n+i]=dy;
+    batch->bullet_live[k*n+i]=1;
+  }
+}
+
+static void spawn(struct Sim_Batch *batch)
+{
+  const int n=batch->count;
+  for(int i=0;i<n;i++)
+  {
+    if(!batch->alive[i] || batch->spawn_in[i]>0)
+      continue;
+    batch->spawn_in[i]=batch->spawn_ticks;
+    float x_pos=(int)(Sim_Rand(&batch->rng[i])%11-5)/2.5;
+    int color=Sim_Rand(&batch->rng[i])%3;
+    if(color==2)
+      color++;
+    int j=0;
+    while(j<BATCH_BRICKS && batch->brick_color[j*n+i]!=-1 && batch->brick_y[j*n+i]>=GRID_MIN)
+      j++;
+    if(j==BATCH_BRICKS)
+      continue;
+    batch->brick_x[j*n+i]=x_pos;
+    batch->brick_y[j*n+i]=4.0;
+    batch->brick_color[j*n+i]=color;
+  }
+}
+
+/* bin_collection for both bins, every brick slot at once */
+BATCH_TARGETS
+static void catch_bricks(struct Sim_Batch *batch)
+{
+  const int n=batch->count;
+  const float top=batch->bin[0].y_pos,bottom=batch->bin[0].y_pos-batch->bin[0].bin_height;
+  const float half_width=batch->bin[0].bin_width/2;
+  const int color0=batch->bin[0].color,color1=batch->bin[1].color;
+  const int *alive=batch->alive.data();
+  const float *bin0=batch->bin_x[0].data(),*bin1=batch->bin_x[1].data();
+  int *score=batch->score.data(),*over=batch->over.data();
+  for(int j=0;j<BATCH_BRICKS;j++)
+  {
+    const float *x_pos=batch->brick_x.data()+j*n,*y_pos=batch->brick_y.data()+j*n;
+    int *colors=batch->brick_color.data()+j*n;
+#pragma GCC ivdep
+    for(int i=0;i<n;i++)
+    {
+      int color=colors[i];
+      int inside=alive[i] & (color!=-1) & (y_pos[i]<=top) & (y_pos[i]-BRICK_B>=bottom);
+      int caught0=inside & (x_pos[i]-BRICK_A/2>=bin0[i]-half_width) & (x_pos[i]+BRICK_A/2<=bin0[i]+half_width);
+      int caught1=inside & !caught0 & (x_pos[i]-BRICK_A/2>=bin1[i]-half_width) & (x_pos[i]+BRICK_A/2<=bin1[i]+half_width);
+      score[i]+=(caught0 & (color==color0))+(caught1 & (color==color1));
+      over[i]|=(caught0|caught1) & (color==3);
+      colors[i]=(caught0|caught1) ? -1 : color;
+    }
+  }
+}
+
+/* move_bullets for bullet slot k of every instance: all instances sweep
+   their first leg together, then their second, and so on; instances with
+   no bullet in the slot or with fewer bounces just sit out as masked lanes */
+BATCH_TARGETS
+static void move_bullets(struct Sim_Batch *batch,int k)
+{
+  const int n=batch->count;
+  const float step=BULLET_SPEED*batch->dt;
+  const int *alive=batch->alive.data();
+  float *bx=batch->bullet_x.data()+k*n,*by=batch->bullet_y.data()+k*n;
+  float *bdx=batch->bullet_dx.data()+k*n,*bdy=batch->bullet_dy.data()+k*n;
+  int *live=batch->bullet_live.data()+k*n;
+  float *hx=batch->hx.data(),*hy=batch->hy.data(),*dx=batch->dx.data(),*dy=batch->dy.data(),*s=batch->s.data();
+  float *x3=batch->x3.data(),*y3=batch->y3.data(),*x4=batch->x4.data(),*y4=batch->y4.data();
+  int *last=batch->last.data(),*active=batch->active.data(),*leg=batch->leg.data();
+  int *score=batch->score.data();
+  // local copies, padded to BATCH_MIRRORS, so the mirror loops unroll fully
+  float mx1[BATCH_MIRRORS],my1[BATCH_MIRRORS],mx2[BATCH_MIRRORS],my2[BATCH_MIRRORS],mnx[BATCH_MIRRORS],mny[BATCH_MIRRORS];
+  int mok[BATCH_MIRRORS];
+  for(int m=0;m<BATCH_MIRRORS;m++)
+  {
+    mok[m]=m<batch->mirror_count;
+    mx1[m]=mok[m] ? batch->mirror_x1[m] : 0;my1[m]=mok[m] ? batch->mirror_y1[m] : 0;
+    mx2[m]=mok[m] ? batch->mirror_x2[m] : 0;my2[m]=mok[m] ? batch->mirror_y2[m] : 0;
+    mnx[m]=mok[m] ? batch->mirror_nx[m] : 0;mny[m]=mok[m] ? batch->mirror_ny[m] : 0;
+  }
+
+#pragma GCC ivdep
+  for(int i=0;i<n;i++)
+  {
+    dx[i]=bdx[i];dy[i]=bdy[i];
+    hx[i]=bx[i]+BULLET_B*dx[i];hy[i]=by[i]+BULLET_B*dy[i];
+    s[i]=step;
+    last[i]=-1;
+    active[i]=live[i] & alive[i];
+  }
+  for(int bounce=0;bounce<=MAX_BOUNCES;bounce++)
+  {
+    const int can_bounce=bounce<MAX_BOUNCES;
+    int any=0;
+#pragma GCC ivdep
+    for(int i=0;i<n;i++)
+    {
+      float ex4=hx[i]+s[i]*dx[i],ey4=hy[i]+s[i]*dy[i];
+      float u=s[i];
+      int hit=-1;
+#pragma GCC unroll 4
+      for(int m=0;m<BATCH_MIRRORS;m++)
+      {
+        float x1=mx1[m],y1=my1[m],x2=mx2[m],y2=my2[m];
+        float ex=x2-x1,ey=y2-y1;
+        float denom=dx[i]*ey-dy[i]*ex;
+        float t=((x1-hx[i])*ey-(y1-hy[i])*ex)/denom;
+        int ok=can_bounce & mok[m] & (m!=last[i]) & (denom!=0)
+          & segments_cross(x1,y1,x2,y2,hx[i],hy[i],ex4,ey4) & ((hit==-1)|(t<u));
+        u=lane_select(ok,t,u);
+        hit^=(hit^m)&-ok;
+      }
+      float px=hx[i]+u*dx[i],py=hy[i]+u*dy[i];
+      x3[i]=hx[i]-1.1f*BULLET_B*dx[i];y3[i]=hy[i]-1.1f*BULLET_B*dy[i];
+      x4[i]=px+0.1f*BULLET_B*dx[i];y4[i]=py+0.1f*BULLET_B*dy[i];
+      leg[i]=active[i];
+      // reflect about the mirror normal, d-2(d.n)n, and turn around the head
+      float nx=0,ny=0;
+#pragma GCC unroll 4
+      for(int m=0;m<BATCH_MIRRORS;m++)
+      {
+        nx=lane_select(hit==m,mnx[m],nx);
+        ny=lane_select(hit==m,mny[m],ny);
+      }
+      int bounced=active[i] & (hit!=-1);
+      float d=2*(dx[i]*nx+dy[i]*ny);
+      float rdx=dx[i]-d*nx,rdy=dy[i]-d*ny;
+      dx[i]=lane_select(bounced,rdx,dx[i]);
+      dy[i]=lane_select(bounced,rdy,dy[i]);
+      hx[i]=lane_select(bounced,px+BULLET_B*rdx,px);
+      hy[i]=lane_select(bounced,py+BULLET_B*rdy,py);
+      s[i]-=u;
+      last[i]=hit;
+      active[i]=bounced;
+      any|=bounced;
+    }
+    for(int j=0;j<BATCH_BRICKS;j++)
+    {
+      const float *x_pos=batch->brick_x.data()+j*n,*y_pos=batch->brick_y.data()+j*n;
+      int *colors=batch->brick_color.data()+j*n;
+#pragma GCC ivdep
+    for(int i=0;i<n;i++)
+      {
+        int color=colors[i];
+        int hit=leg[i] & (color!=-1)
+          & segments_cross(x_pos[i],y_pos[i],x_pos[i],y_pos[i]-BRICK_B,x3[i],y3[i],x4[i],y4[i]);
+        score[i]+=hit & (color==3);
+        colors[i]=hit ? -1 : color;
+      }
+    }
+    if(!any)
+      break;
+  }
+#pragma GCC ivdep
+  for(int i=0;i<n;i++)
+  {
+    int moved=live[i] & alive[i];
+    float x=hx[i]-BULLET_B*dx[i],y=hy[i]-BULLET_B*dy[i];
+    bx[i]=lane_select(moved,x,bx[i]);
+    by[i]=lane_select(moved,y,by[i]);
+    bdx[i]=lane_select(moved,dx[i],bdx[i]);
+    bdy[i]=lane_select(moved,dy[i],bdy[i]);
+    live[i]&=(x>=-4) & (x<=4) & (y>=-4) & (y<=4);
+  }
+}
+
+BATCH_TARGETS
+static void fall_bricks(struct Sim_Batch *batch)
+{
+  const int n=batch->count;
+  const float scale=batch->dt/SIM_DT;
+  const int *alive=batch->alive.data();
+  const float *speed=batch->brick_speed.data();
+  for(int j=0;j<BATCH_BRICKS;j++)
+  {
+    float *y_pos=batch->brick_y.data()+j*n;
+    const int *colors=batch->brick_color.data()+j*n;
+#pragma GCC ivdep
+    for(int i=0;i<n;i++)
+      y_pos[i]-=lane_select(alive[i] & (colors[i]!=-1),speed[i]*scale,0);
+  }
+}
+
+void Batch_Step(struct Sim_Batch *batch)
+{
+  const int n=batch->count;
+  for(int i=0;i<n;i++)
+  {
+    int alive=!batch->over[i];
+    batch->alive[i]=alive;
+    batch->tick[i]+=alive;
+    batch->reload_in[i]-=alive;
+    batch->spawn_in[i]-=alive;
+  }
+  fire(batch);
+  catch_bricks(batch);
+  for(int k=0;k<BATCH_BULLETS;k++)
+  {
+    // slots fill from 0, so the high ones are usually empty everywhere
+    const int *live=batch->bullet_live.data()+k*n;
+    int used=0;
+    for(int i=0;i<n;i++)
+      used|=live[i];
+    if(used)
+      move_bullets(batch,k);
+  }
+  fall_bricks(batch);
+  spawn(batch);
+}
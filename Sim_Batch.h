@@ -0,0 +1,74 @@
+#ifndef SIM_BATCH_H
+#define SIM_BATCH_H
+
+#include <vector>
+
+#include "Simulation.h"
+
+/* Many independent games stepped together, for Monte Carlo runs and bot
+   training. The rules are those of Simulation.cpp (same playfield, bins,
+   gun, mirrors, brick and bullet sizes and speeds) but every instance has a
+   fixed number of brick and bullet slots, so the state of all instances
+   can live in flat arrays and each tick is a handful of branch-free loops
+   over instances that the compiler turns into SIMD code, one instance per
+   lane. No GL, no allocation after Batch_Init.
+
+   Per-slot arrays are indexed [slot*count+instance]; per-instance arrays
+   [instance]. Differences from struct Game:
+   - a spawn is skipped if all BATCH_BRICKS slots are busy (a slot frees up
+     when its brick is caught, hit or falls below GRID_MIN, as in Sim_Step)
+   - a shot is skipped if all BATCH_BULLETS slots are busy
+   - the gun fires by itself whenever it has reloaded, along aim[i], or at
+     a random angle in [-80,80] when bot is set (like the --headless bot)
+   - at most BATCH_MIRRORS mirrors, the default level's unless
+     Batch_Set_Mirrors gives others: the mirror loops are unrolled over
+     them instead of walking Game's BVH */
+
+#define BATCH_BRICKS 16
+#define BATCH_BULLETS 8
+#define BATCH_MIRRORS 4
+
+struct Sim_Batch {
+  int count;            // instances
+  double dt;
+  int spawn_ticks,reload_ticks;
+  bool bot;
+  // shared layout, taken from a fresh struct Game
+  struct Sim_Bin bin[2];
+  struct Sim_Gun gun;
+  float mirror_x1[BATCH_MIRRORS],mirror_y1[BATCH_MIRRORS];
+  float mirror_x2[BATCH_MIRRORS],mirror_y2[BATCH_MIRRORS];
+  float mirror_nx[BATCH_MIRRORS],mirror_ny[BATCH_MIRRORS];
+  int mirror_count;
+  // per instance
+  std::vector<unsigned int> rng;     // Sim_Rand state, Sim_Seed(seed,instance)
+  std::vector<long> tick;
+  std::vector<int> score;
+  std::vector<int> over;             // 1 once a black brick was caught
+  std::vector<int> spawn_in,reload_in;   // ticks until the next brick / shot
+  std::vector<float> brick_speed;    // Speed_of_Brick
+  std::vector<float> gun_y;
+  std::vector<float> aim;            // degrees
+  std::vector<float> bin_x[2];       // bins only move sideways
+  // per slot
+  std::vector<float> brick_x,brick_y;
+  std::vector<int> brick_color;      // -1 for a free slot
+  std::vector<float> bullet_x,bullet_y,bullet_dx,bullet_dy;   // tail and unit direction
+  std::vector<int> bullet_live;
+  // scratch, per instance
+  std::vector<float> hx,hy,dx,dy,s,x3,y3,x4,y4;
+  std::vector<int> last,active,leg,alive;
+};
+
+/* Set up count fresh instances; instance i is seeded from seed and i */
+void Batch_Init(struct Sim_Batch *batch,int count,unsigned int seed);
+void Batch_Set_Tick(struct Sim_Batch *batch,double dt);
+/* Use the mirrors of level in every instance; false if it has more than
+   BATCH_MIRRORS */
+bool Batch_Set_Mirrors(struct Sim_Batch *batch,const struct Game *level);
+/* Start instance i over as a new game */
+void Batch_Reset(struct Sim_Batch *batch,int i,unsigned int seed);
+/* Advance every instance that is not over by one tick */
+void Batch_Step(struct Sim_Batch *batch);
+
+#endif
@@ -0,0 +1,185 @@
+/* Benchmarks of the simulation kernels on seeded synthetic scenes, without a
+   window. Each scene is stepped twice for a number of ticks: once with
+   only the whole Sim_Step timed, for the tick column, and once with the
+   phases timed through Sim_Profile, reported in ns per entity they loop
+   over (bricks for catch, grid and fall, bullets for bullets and
+   reflection). Bricks and bullets are topped up between ticks so the scene
+   keeps its size. The sweeps vary one of bricks, bullets and mirrors at a
+   time, which gives the scaling curve of each kernel.
+
+     ./sim_bench [--ticks N] [--seed S] [--threads N] [--kernel NAME] */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "Simulation.h"
+#include "Sim_Kernel.h"
+#include "Sim_Profile.h"
+#include "Thread_Pool.h"
+
+using namespace std;
+
+struct Game game;
+struct Sim_Profile profile;
+
+struct Scene_Size {
+  int bricks,bullets,mirrors;
+};
+
+void Add_Bullets(unsigned int *rng,int n)
+{
+  for(int i=0;i<n;i++)
+  {
+    double angle=(Sim_Rand(rng)%360)*M_PI/180;
+    float x_pos=((int)(Sim_Rand(rng)%8001)-4000)/1000.0;
+    float y_pos=((int)(Sim_Rand(rng)%8001)-4000)/1000.0;
+    Sim_Add_Bullet(&game,x_pos,y_pos,cos(angle),sin(angle));
+  }
+}
+
+/* Median of a phase in ns, divided over n entities */
+double Per_Entity(int phase,int n)
+{
+  return Profile_Get(&profile,phase).p50*1000/(n>0 ? n : 1);
+}
+
+void Start_Scene(struct Scene_Size size,unsigned int seed,struct Thread_Pool *pool,unsigned int *rng)
+{
+  *rng=Sim_Seed(seed,3);
+  Sim_Init(&game,seed);
+  Sim_Scatter_Mirrors(&game,size.mirrors,seed);
+  game.endless=true;
+  game.threads=pool;
+  Sim_Populate(&game,size.bricks);
+  Add_Bullets(rng,size.bullets);
+}
+
+void Top_Up(struct Scene_Size size,unsigned int *rng)
+{
+  if(game.bricks.pool.count<size.bricks)
+    Sim_Populate(&game,size.bricks-game.bricks.pool.count);
+  if(game.bullets.pool.count<size.bullets)
+    Add_Bullets(rng,size.bullets-game.bullets.pool.count);
+}
+
+void Run_Scene(struct Scene_Size size,int ticks,unsigned int seed,struct Thread_Pool *pool)
+{
+  unsigned int rng;
+  // unprofiled: Sim_Step alone, timed from outside
+  Start_Scene(size,seed,pool,&rng);
+  vector<float> tick_us(ticks);
+  for(int t=0;t<ticks;t++)
+  {
+    Top_Up(size,&rng);
+    double start=Profile_Now();
+    Sim_Step(&game);
+    tick_us[t]=Profile_Now()-start;
+  }
+  sort(tick_us.begin(),tick_us.end());
+  double tick=ticks>0 ? tick_us[(ticks-1)/2] : 0;
+
+  Start_Scene(size,seed,pool,&rng);
+  Profile_Clear(&profile);
+  game.profile=&profile;
+  for(int t=0;t<ticks;t++)
+  {
+    Top_Up(size,&rng);
+    Sim_Step(&game);
+  }
+  game.profile=NULL;
+  game.threads=NULL;
+  char line[200];
+  snprintf(line,sizeof(line),"%8d %8d %8d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %12.2f",
+    size.bricks,size.bullets,size.mirrors,
+    Per_Entity(PHASE_CATCH,size.bricks),Per_Entity(PHASE_GRID,size.bricks),Per_Entity(PHASE_FALL,size.bricks),
+    Per_Entity(PHASE_BULLETS,size.bullets),Per_Entity(PHASE_REFLECTION,size.bullets),
+    Per_Entity(PHASE_SPAWN,1),tick);
+  cout << line << endl;
+}
+
+/* reflection() is BVH_First_Hit on the mirror BVH: time it alone on random
+   legs of one tick's length */
+void Run_Reflection(int mirrors,unsigned int seed)
+{
+  const int legs=200000;
+  unsigned int rng=Sim_Seed(seed,4);
+  Sim_Init(&game,seed);
+  Sim_Scatter_Mirrors(&game,mirrors,seed);
+  float s=BULLET_SPEED*SIM_DT;
+  vector<float> hx(legs),hy(legs),dx(legs),dy(legs);
+  for(int i=0;i<legs;i++)
+  {
+    double angle=(Sim_Rand(&rng)%3600)*M_PI/1800;
+    hx[i]=((int)(Sim_Rand(&rng)%8001)-4000)/1000.0;
+    hy[i]=((int)(Sim_Rand(&rng)%8001)-4000)/1000.0;
+    dx[i]=cos(angle);dy[i]=sin(angle);
+  }
+  int hits=0;
+  chrono::steady_clock::time_point start=chrono::steady_clock::now();
+  for(int i=0;i<legs;i++)
+  {
+    float u;
+    hits+=BVH_First_Hit(&game.mirror_bvh,hx[i],hy[i],dx[i],dy[i],s,-1,&u)!=-1;
+  }
+  double ns=chrono::duration<double,nano>(chrono::steady_clock::now()-start).count();
+  char line[120];
+  snprintf(line,sizeof(line),"%8d %10.2f %8.4f",mirrors,ns/legs,hits/(double)legs);
+  cout << line << endl;
+}
+
+int main(int argc,char **argv)
+{
+  int ticks=200,threads=1;
+  unsigned int seed=1;
+  for(int i=1;i<argc;i++)
+  {
+    if(!strcmp(argv[i],"--ticks")&&i+1<argc)
+      ticks=atoi(argv[++i]);
+    else if(!strcmp(argv[i],"--seed")&&i+1<argc)
+      seed=strtoul(argv[++i],NULL,10);
+    else if(!strcmp(argv[i],"--threads")&&i+1<argc)
+      threads=atoi(argv[++i]);
+    else if(!strcmp(argv[i],"--kernel")&&i+1<argc)
+    {
+      if(!Segment_Hits_Select(argv[++i]))
+        cerr << "Kernel " << argv[i] << " not available, using " << Segment_Hits_Name() << endl;
+    }
+  }
+  struct Thread_Pool *pool=threads>1 ? Thread_Pool_Create(threads) : NULL;
+  Profile_Init(&profile,"sim",sim_phase_name,SIM_PHASES);
+  cout << "Kernel: " << Segment_Hits_Name() << " Threads: " << Thread_Pool_Size(pool)
+       << " Ticks: " << ticks << " Seed: " << seed << endl;
+  cout << "Median ns per entity (catch, grid, fall: per brick; bullets, reflection: per bullet;"
+       << " spawn: per tick), tick in us unprofiled" << endl;
+  const char *header="  bricks  bullets  mirrors      catch       grid       fall    bullets reflection      spawn         tick";
+
+  static const struct Scene_Size brick_sweep[]={
+    {10,100,3},{100,100,3},{1000,100,3},{10000,100,3},{100000,100,3}};
+  static const struct Scene_Size bullet_sweep[]={
+    {1000,10,3},{1000,100,3},{1000,1000,3},{1000,10000,3}};
+  static const struct Scene_Size mirror_sweep[]={
+    {1000,1000,3},{1000,1000,10},{1000,1000,100},{1000,1000,1000}};
+  cout << endl << "Bricks" << endl << header << endl;
+  for(size_t i=0;i<sizeof(brick_sweep)/sizeof(brick_sweep[0]);i++)
+    Run_Scene(brick_sweep[i],ticks,seed,pool);
+  cout << endl << "Bullets" << endl << header << endl;
+  for(size_t i=0;i<sizeof(bullet_sweep)/sizeof(bullet_sweep[0]);i++)
+    Run_Scene(bullet_sweep[i],ticks,seed,pool);
+  cout << endl << "Mirrors" << endl << header << endl;
+  for(size_t i=0;i<sizeof(mirror_sweep)/sizeof(mirror_sweep[0]);i++)
+    Run_Scene(mirror_sweep[i],ticks,seed,pool);
+
+  static const int reflection_sweep[]={3,10,100,1000};
+  cout << endl << "Reflection alone (one mirror query per leg)" << endl
+       << " mirrors    ns/leg  hit rate" << endl;
+  for(size_t i=0;i<sizeof(reflection_sweep)/sizeof(reflection_sweep[0]);i++)
+    Run_Reflection(reflection_sweep[i],seed);
+
+  Thread_Pool_Destroy(pool);
+  return 0;
+}
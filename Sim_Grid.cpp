@@ -0,0 +1,59 @@
+#include <cmath>
+
+#include "Sim_Grid.h"
+
+static int grid_coord(float v)
+{
+  int c=(int)floorf((v-GRID_MIN)/GRID_CELL);
+  return c<0 ? 0 : (c>=GRID_DIM ? GRID_DIM-1 : c);
+}
+
+bool Grid_Cells(float x0,float y0,float x1,float y1,int *cx0,int *cy0,int *cx1,int *cy1)
+{
+  const float grid_max=GRID_MIN+GRID_DIM*GRID_CELL;
+  if(x1<GRID_MIN || y1<GRID_MIN || x0>grid_max || y0>grid_max)
+    return false;
+  *cx0=grid_coord(x0);*cx1=grid_coord(x1);
+  *cy0=grid_coord(y0);*cy1=grid_coord(y1);
+  return true;
+}
+
+void Grid_Build(struct Sim_Grid *grid,const float *x_pos,const float *y_pos,const float *b,const int *color,int count)
+{
+  const int cells=GRID_DIM*GRID_DIM;
+  int cx0,cy0,cx1,cy1;
+  grid->cell_start.assign(cells+1,0);
+
+  // count the bricks per cell ...
+  for(int j=0;j<count;j++)
+  {
+    if(color[j]==-1 || !Grid_Cells(x_pos[j],y_pos[j]-b[j],x_pos[j],y_pos[j],&cx0,&cy0,&cx1,&cy1))
+      continue;
+    for(int cy=cy0;cy<=cy1;cy++)
+      grid->cell_start[cy*GRID_DIM+cx0+1]++;
+  }
+  // ... turn the counts into offsets ...
+  for(int c=0;c<cells;c++)
+    grid->cell_start[c+1]+=grid->cell_start[c];
+  int total=grid->cell_start[cells];
+  grid->item.resize(total);
+  grid->x_pos.resize(total);
+  grid->y_top.resize(total);
+  grid->y_bottom.resize(total);
+  grid->cursor.assign(grid->cell_start.begin(),grid->cell_start.end()-1);
+
+  // ... and scatter them
+  for(int j=0;j<count;j++)
+  {
+    if(color[j]==-1 || !Grid_Cells(x_pos[j],y_pos[j]-b[j],x_pos[j],y_pos[j],&cx0,&cy0,&cx1,&cy1))
+      continue;
+    for(int cy=cy0;cy<=cy1;cy++)
+    {
+      int k=grid->cursor[cy*GRID_DIM+cx0]++;
+      grid->item[k]=j;
+      grid->x_pos[k]=x_pos[j];
+      grid->y_top[k]=y_pos[j];
+      grid->y_bottom[k]=y_pos[j]-b[j];
+    }
+  }
+}
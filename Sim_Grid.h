@@ -0,0 +1,29 @@
+#ifndef SIM_GRID_H
+#define SIM_GRID_H
+
+#include <vector>
+
+/* Uniform grid broadphase over the playfield (with a margin for bullets
+   poking out of it). Bricks are vertical segments and are binned into every
+   cell their extent overlaps; a bullet then only tests the bricks of the
+   cells its segment covers. Rebuilt from scratch each tick with a counting
+   sort, so per cell the brick data is contiguous */
+#define GRID_MIN -5.0f
+#define GRID_CELL 0.5f
+#define GRID_DIM 20
+
+struct Sim_Grid {
+  std::vector<int> cell_start;   // GRID_DIM*GRID_DIM+1 offsets into the arrays below
+  std::vector<int> item;         // dense brick index
+  std::vector<float> x_pos;      // brick segment, copied in cell order
+  std::vector<float> y_top;
+  std::vector<float> y_bottom;
+  std::vector<int> cursor;
+};
+
+/* Bin every brick with color!=-1 */
+void Grid_Build(struct Sim_Grid *grid,const float *x_pos,const float *y_pos,const float *b,const int *color,int count);
+/* Cell rectangle [cx0,cx1]x[cy0,cy1] overlapped by the box, false if it misses the grid */
+bool Grid_Cells(float x0,float y0,float x1,float y1,int *cx0,int *cy0,int *cx1,int *cy1);
+
+#endif
@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cmath>
+
+#include "Sim_Input.h"
+#include "Simulation.h"
+#include "Sim_Replay.h"
+#include "Sim_Rewind.h"
+
+double Input_Clock()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Input_Ring_Init(struct Sim_Input_Ring *ring)
+{
+  ring->head.store(0);
+  ring->tail.store(0);
+  ring->dropped=0;
+}
+
+bool Input_Push(struct Sim_Input_Ring *ring,int type,int target,float x,float y)
+{
+  return Input_Push_At(ring,Input_Clock(),type,target,x,y);
+}
+
+bool Input_Push(struct Sim_Input_Ring *ring,int type)
+{
+  return Input_Push(ring,type,0,0,0);
+}
+
+bool Input_Push_At(struct Sim_Input_Ring *ring,double time,int type,int target,float x,float y)
+{
+  unsigned int head=ring->head.load(std::memory_order_relaxed);
+  if(head-ring->tail.load(std::memory_order_acquire)==INPUT_RING_SIZE)
+  {
+    ring->dropped++;
+    return false;
+  }
+  struct Sim_Input_Event &event=ring->event[head&(INPUT_RING_SIZE-1)];
+  event.time=time;
+  event.type=type;
+  event.target=target;
+  event.x=x;
+  event.y=y;
+  ring->head.store(head+1,std::memory_order_release);
+  return true;
+}
+
+void Sim_Drain_Input(struct Game *game,double time)
+{
+  struct Sim_Input_Ring *ring=game->input;
+  unsigned int tail=ring->tail.load(std::memory_order_relaxed);
+  unsigned int head=ring->head.load(std::memory_order_acquire);
+  for(;tail!=head;tail++)
+  {
+    const struct Sim_Input_Event *event=&ring->event[tail&(INPUT_RING_SIZE-1)];
+    if(event->time>time)
+      break;
+    Sim_Apply_Input(game,event);
+  }
+  ring->tail.store(tail,std::memory_order_release);
+}
+
+void Sim_Apply_Input(struct Game *game,const struct Sim_Input_Event *event)
+{
+  struct Sim_Gun *gun=&game->gun;
+  if(game->recorder)
+    Recorder_Event(game->recorder,game->tick,event);
+  switch(event->type)
+  {
+    case SIM_INPUT_ROTATE_GUN:
+      if(event->x>0 ? gun->rot_angle<80 : gun->rot_angle>-80)
+        gun->rot_angle+=event->x;
+      break;
+    case SIM_INPUT_MOVE_GUN:
+      if(event->x>0 ? gun->y_pos<3.5 : gun->y_pos>-3.5)
+        gun->y_pos+=event->x;
+      break;
+    case SIM_INPUT_SET_GUN:
+      gun->y_pos=event->x;
+      break;
+    case SIM_INPUT_MOVE_BIN:
+      game->bin[event->target].x_pos+=event->x;
+      break;
+    case SIM_INPUT_SET_BIN:
+      game->bin[event->target].x_pos=event->x;
+      break;
+    case SIM_INPUT_BRICK_SPEED:
+      if(event->x>0 ? game->Speed_of_Brick<0.05 : game->Speed_of_Brick>0.01)
+        game->Speed_of_Brick+=event->x;
+      break;
+    case SIM_INPUT_FIRE:
+      Sim_Fire(game);
+      break;
+    case SIM_INPUT_AIM:
+      if(Sim_Can_Fire(game))
+      {
+        gun->rot_angle=atan((event->y-gun->y_pos)/(event->x-gun->x_pos))*180/M_PI;
+        Sim_Fire(game);
+      }
+      break;
+    case SIM_INPUT_SET_ANGLE:
+      gun->rot_angle=event->x;
+      break;
+    case SIM_INPUT_REWIND:
+      if(game->rewind)
+      {
+        // the tick being run continues from the restored one
+        long tick=game->tick;
+        long restored=Rewind_Restore(game->rewind,game,tick-1-(long)(event->x/game->dt+0.5));
+        if(restored<0)
+          break;
+        game->tick=restored+1;
+        game->sim_time=game->tick*game->dt;
+        game->input_epoch+=(tick-game->tick)*game->dt;
+      }
+      break;
+    default:
+      break;
+  }
+}
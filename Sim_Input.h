@@ -0,0 +1,60 @@
+#ifndef SIM_INPUT_H
+#define SIM_INPUT_H
+
+#include <atomic>
+
+struct Game;
+
+/* Player input as events. Window callbacks push them into a Sim_Input_Ring
+   instead of touching struct Game; the simulation drains the ring at the
+   start of each tick, so every event lands on an exact tick no matter which
+   thread produced it */
+
+enum Sim_Input_Type {
+  SIM_INPUT_ROTATE_GUN,    // x = degrees, clamped to +-80
+  SIM_INPUT_MOVE_GUN,      // x = distance along y, clamped to +-3.5
+  SIM_INPUT_SET_GUN,       // x = y position
+  SIM_INPUT_MOVE_BIN,      // target = bin, x = distance
+  SIM_INPUT_SET_BIN,       // target = bin, x = x position
+  SIM_INPUT_BRICK_SPEED,   // x = change of Speed_of_Brick, kept in [0.01,0.05]
+  SIM_INPUT_FIRE,
+  SIM_INPUT_AIM,           // point the gun at (x,y) and fire, if reloaded
+  SIM_INPUT_SET_ANGLE,     // x = gun angle in degrees (the headless bot)
+  SIM_INPUT_REWIND         // x = seconds to go back, if game->rewind is set
+};
+
+struct Sim_Input_Event {
+  double time;   // Input_Clock() when the event happened
+  int type;
+  int target;
+  float x,y;
+};
+
+#define INPUT_RING_SIZE 1024   // power of two
+
+/* Single producer / single consumer ring. head and tail only ever grow and
+   are masked on access; each is written by one side only */
+struct Sim_Input_Ring {
+  struct Sim_Input_Event event[INPUT_RING_SIZE];
+  alignas(64) std::atomic<unsigned int> head;   // written by the producer
+  alignas(64) std::atomic<unsigned int> tail;   // written by the consumer
+  unsigned int dropped;                         // pushes lost to a full ring
+};
+
+/* Seconds on a monotonic clock, the time base of Sim_Input_Event.time and
+   Game.input_epoch */
+double Input_Clock();
+
+void Input_Ring_Init(struct Sim_Input_Ring *ring);
+/* Producer side. Returns false (and counts a drop) if the ring is full */
+bool Input_Push(struct Sim_Input_Ring *ring,int type,int target,float x,float y);
+bool Input_Push(struct Sim_Input_Ring *ring,int type);
+/* Push with an explicit time stamp instead of Input_Clock() */
+bool Input_Push_At(struct Sim_Input_Ring *ring,double time,int type,int target,float x,float y);
+
+/* Consumer side: apply every queued event stamped at or before time */
+void Sim_Drain_Input(struct Game *game,double time);
+/* Apply one event now, logging it to game->recorder if set */
+void Sim_Apply_Input(struct Game *game,const struct Sim_Input_Event *event);
+
+#endif
@@ -0,0 +1,124 @@
+#include <cstring>
+
+#include "Sim_Kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIM_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+/* Set the bits of segments [k,n) in an already cleared mask */
+static inline void segment_hits_tail(const float *x1,const float *y1,const float *x2,const float *y2,int k,int n,
+  float x3,float y3,float x4,float y4,unsigned int *mask)
+{
+  for(;k<n;k++)
+  {
+    float check1=(y1[k]-y2[k])*(x3-x1[k])-(x1[k]-x2[k])*(y3-y1[k]);
+    float check2=(y1[k]-y2[k])*(x4-x1[k])-(x1[k]-x2[k])*(y4-y1[k]);
+    float check3=(y3-y4)*(x1[k]-x3)-(x3-x4)*(y1[k]-y3);
+    float check4=(y3-y4)*(x2[k]-x3)-(x3-x4)*(y2[k]-y3);
+    if(check1*check2<=0 && check3*check4<=0)
+      mask[k>>5]|=1u<<(k&31);
+  }
+}
+
+static void segment_hits_scalar(const float *x1,const float *y1,const float *x2,const float *y2,int n,
+  float x3,float y3,float x4,float y4,unsigned int *mask)
+{
+  memset(mask,0,((n+31)/32)*sizeof(unsigned int));
+  segment_hits_tail(x1,y1,x2,y2,0,n,x3,y3,x4,y4,mask);
+}
+
+#ifdef SIM_KERNEL_X86
+/* SSE2 is part of x86-64, so this one needs no runtime check */
+static void segment_hits_sse2(const float *x1,const float *y1,const float *x2,const float *y2,int n,
+  float x3,float y3,float x4,float y4,unsigned int *mask)
+{
+  const __m128 X3=_mm_set1_ps(x3),Y3=_mm_set1_ps(y3),X4=_mm_set1_ps(x4),Y4=_mm_set1_ps(y4);
+  const __m128 DX=_mm_set1_ps(x3-x4),DY=_mm_set1_ps(y3-y4),zero=_mm_setzero_ps();
+  int k=0;
+  memset(mask,0,((n+31)/32)*sizeof(unsigned int));
+  for(;k+4<=n;k+=4)
+  {
+    __m128 X1=_mm_loadu_ps(x1+k),Y1=_mm_loadu_ps(y1+k),X2=_mm_loadu_ps(x2+k),Y2=_mm_loadu_ps(y2+k);
+    __m128 ey=_mm_sub_ps(Y1,Y2),ex=_mm_sub_ps(X1,X2);
+    __m128 check1=_mm_sub_ps(_mm_mul_ps(ey,_mm_sub_ps(X3,X1)),_mm_mul_ps(ex,_mm_sub_ps(Y3,Y1)));
+    __m128 check2=_mm_sub_ps(_mm_mul_ps(ey,_mm_sub_ps(X4,X1)),_mm_mul_ps(ex,_mm_sub_ps(Y4,Y1)));
+    __m128 check3=_mm_sub_ps(_mm_mul_ps(DY,_mm_sub_ps(X1,X3)),_mm_mul_ps(DX,_mm_sub_ps(Y1,Y3)));
+    __m128 check4=_mm_sub_ps(_mm_mul_ps(DY,_mm_sub_ps(X2,X3)),_mm_mul_ps(DX,_mm_sub_ps(Y2,Y3)));
+    __m128 hit=_mm_and_ps(_mm_cmple_ps(_mm_mul_ps(check1,check2),zero),_mm_cmple_ps(_mm_mul_ps(check3,check4),zero));
+    mask[k>>5]|=(unsigned int)_mm_movemask_ps(hit)<<(k&31);
+  }
+  segment_hits_tail(x1,y1,x2,y2,k,n,x3,y3,x4,y4,mask);
+}
+
+__attribute__((target("avx2")))
+static void segment_hits_avx2(const float *x1,const float *y1,const float *x2,const float *y2,int n,
+  float x3,float y3,float x4,float y4,unsigned int *mask)
+{
+  const __m256 X3=_mm256_set1_ps(x3),Y3=_mm256_set1_ps(y3),X4=_mm256_set1_ps(x4),Y4=_mm256_set1_ps(y4);
+  const __m256 DX=_mm256_set1_ps(x3-x4),DY=_mm256_set1_ps(y3-y4),zero=_mm256_setzero_ps();
+  int k=0;
+  memset(mask,0,((n+31)/32)*sizeof(unsigned int));
+  for(;k+8<=n;k+=8)
+  {
+    __m256 X1=_mm256_loadu_ps(x1+k),Y1=_mm256_loadu_ps(y1+k),X2=_mm256_loadu_ps(x2+k),Y2=_mm256_loadu_ps(y2+k);
+    __m256 ey=_mm256_sub_ps(Y1,Y2),ex=_mm256_sub_ps(X1,X2);
+    __m256 check1=_mm256_sub_ps(_mm256_mul_ps(ey,_mm256_sub_ps(X3,X1)),_mm256_mul_ps(ex,_mm256_sub_ps(Y3,Y1)));
+    __m256 check2=_mm256_sub_ps(_mm256_mul_ps(ey,_mm256_sub_ps(X4,X1)),_mm256_mul_ps(ex,_mm256_sub_ps(Y4,Y1)));
+    __m256 check3=_mm256_sub_ps(_mm256_mul_ps(DY,_mm256_sub_ps(X1,X3)),_mm256_mul_ps(DX,_mm256_sub_ps(Y1,Y3)));
+    __m256 check4=_mm256_sub_ps(_mm256_mul_ps(DY,_mm256_sub_ps(X2,X3)),_mm256_mul_ps(DX,_mm256_sub_ps(Y2,Y3)));
+    __m256 hit=_mm256_and_ps(_mm256_cmp_ps(_mm256_mul_ps(check1,check2),zero,_CMP_LE_OQ),
+                             _mm256_cmp_ps(_mm256_mul_ps(check3,check4),zero,_CMP_LE_OQ));
+    mask[k>>5]|=(unsigned int)_mm256_movemask_ps(hit)<<(k&31);
+  }
+  segment_hits_tail(x1,y1,x2,y2,k,n,x3,y3,x4,y4,mask);
+}
+#endif
+
+static Segment_Hits_Fn select_segment_hits()
+{
+#ifdef SIM_KERNEL_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    return segment_hits_avx2;
+  return segment_hits_sse2;
+#else
+  return segment_hits_scalar;
+#endif
+}
+
+Segment_Hits_Fn Segment_Hits=select_segment_hits();
+
+bool Segment_Hits_Select(const char *name)
+{
+  if(!strcmp(name,"scalar"))
+  {
+    Segment_Hits=segment_hits_scalar;
+    return true;
+  }
+#ifdef SIM_KERNEL_X86
+  if(!strcmp(name,"sse2"))
+  {
+    Segment_Hits=segment_hits_sse2;
+    return true;
+  }
+  if(!strcmp(name,"avx2") && __builtin_cpu_supports("avx2"))
+  {
+    Segment_Hits=segment_hits_avx2;
+    return true;
+  }
+#endif
+  return false;
+}
+
+const char *Segment_Hits_Name()
+{
+  if(Segment_Hits==segment_hits_scalar)
+    return "scalar";
+#ifdef SIM_KERNEL_X86
+  if(Segment_Hits==segment_hits_avx2)
+    return "avx2";
+#endif
+  return "sse2";
+}
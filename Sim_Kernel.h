@@ -0,0 +1,23 @@
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+/* Batched segment intersection: one segment (x3,y3)-(x4,y4) against n
+   segments (x1[k],y1[k])-(x2[k],y2[k]) given as arrays. Bit k%32 of
+   mask[k/32] is set when segment k is hit; mask must hold (n+31)/32 words.
+   The test is the same orientation (check) test the game always used:
+   both endpoints of each segment lie on opposite sides of (or on) the other.
+
+   Segment_Hits points at the widest implementation the CPU supports
+   (AVX2: 8 segments per instruction, SSE2: 4, scalar fallback), picked at
+   startup. All of them return bit-identical masks. */
+typedef void (*Segment_Hits_Fn)(const float *x1,const float *y1,const float *x2,const float *y2,int n,
+  float x3,float y3,float x4,float y4,unsigned int *mask);
+
+extern Segment_Hits_Fn Segment_Hits;
+
+/* Force an implementation ("scalar", "sse2" or "avx2"); false if it is not
+   available on this CPU/build */
+bool Segment_Hits_Select(const char *name);
+const char *Segment_Hits_Name();
+
+#endif
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "Sim_Profile.h"
+
+void Profile_Init(struct Sim_Profile *profile,const char *label,const char *const *names,int phases)
+{
+  profile->label=label;
+  profile->phases=std::min(phases,PROFILE_PHASES);
+  for(int p=0;p<profile->phases;p++)
+  {
+    profile->name[p]=names[p];
+    profile->sample[p].reserve(PROFILE_WINDOW);
+  }
+  Profile_Clear(profile);
+}
+
+void Profile_Clear(struct Sim_Profile *profile)
+{
+  for(int p=0;p<profile->phases;p++)
+  {
+    profile->sample[p].clear();
+    profile->count[p]=0;
+    profile->total[p]=profile->max[p]=0;
+  }
+}
+
+void Profile_Add(struct Sim_Profile *profile,int phase,double us)
+{
+  std::vector<float> &sample=profile->sample[phase];
+  if(sample.size()<PROFILE_WINDOW)
+    sample.push_back(us);
+  else
+    sample[profile->count[phase]%PROFILE_WINDOW]=us;
+  profile->count[phase]++;
+  profile->total[phase]+=us;
+  if(us>profile->max[phase])
+    profile->max[phase]=us;
+}
+
+/* Nearest rank percentile of sorted samples */
+static double percentile(const std::vector<float> &sorted,double p)
+{
+  if(sorted.empty())
+    return 0;
+  size_t k=(size_t)ceil(p*sorted.size());
+  return sorted[k>0 ? k-1 : 0];
+}
+
+struct Profile_Stats Profile_Get(const struct Sim_Profile *profile,int phase)
+{
+  struct Profile_Stats stats;
+  std::vector<float> sorted(profile->sample[phase]);
+  std::sort(sorted.begin(),sorted.end());
+  stats.count=profile->count[phase];
+  stats.mean=stats.count>0 ? profile->total[phase]/stats.count : 0;
+  stats.p50=percentile(sorted,0.50);
+  stats.p95=percentile(sorted,0.95);
+  stats.p99=percentile(sorted,0.99);
+  stats.max=profile->max[phase];
+  return stats;
+}
+
+void Profile_Report(const struct Sim_Profile *profile)
+{
+  char line[160];
+  std::cout << "Profile " << profile->label << " (us): mean p50 p95 p99 max" << std::endl;
+  for(int p=0;p<profile->phases;p++)
+  {
+    struct Profile_Stats s=Profile_Get(profile,p);
+    snprintf(line,sizeof(line),"  %-12s %9.3f %9.3f %9.3f %9.3f %9.3f",profile->name[p],s.mean,s.p50,s.p95,s.p99,s.max);
+    std::cout << line << std::endl;
+  }
+}
+
+bool Profile_Write(const struct Sim_Profile *const *profiles,int n,const char *path)
+{
+  size_t length=strlen(path);
+  bool json=length>=5 && !strcmp(path+length-5,".json");
+  FILE *file=fopen(path,"w");
+  if(!file)
+  {
+    std::cerr << "Cannot write profile " << path << std::endl;
+    return false;
+  }
+  if(json)
+    fprintf(file,"[\n");
+  else
+    fprintf(file,"profile,phase,samples,mean_us,p50_us,p95_us,p99_us,max_us\n");
+  for(int i=0;i<n;i++)
+    for(int p=0;p<profiles[i]->phases;p++)
+    {
+      struct Profile_Stats s=Profile_Get(profiles[i],p);
+      if(json)
+        fprintf(file,"  {\"profile\": \"%s\", \"phase\": \"%s\", \"samples\": %ld, \"mean_us\": %.3f, "
+          "\"p50_us\": %.3f, \"p95_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}%s\n",
+          profiles[i]->label,profiles[i]->name[p],s.count,s.mean,s.p50,s.p95,s.p99,s.max,
+          i==n-1 && p==profiles[i]->phases-1 ? "" : ",");
+      else
+        fprintf(file,"%s,%s,%ld,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+          profiles[i]->label,profiles[i]->name[p],s.count,s.mean,s.p50,s.p95,s.p99,s.max);
+    }
+  if(json)
+    fprintf(file,"]\n");
+  if(fclose(file)!=0)
+  {
+    std::cerr << "Cannot write profile " << path << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,59 @@
+#ifndef SIM_PROFILE_H
+#define SIM_PROFILE_H
+
+#include <chrono>
+#include <vector>
+
+/* CPU time per phase of a loop (the ticks of Sim_Step, the frames of the
+   window). Every phase keeps its last PROFILE_WINDOW samples for the
+   percentiles plus running totals over the whole run. A profile is written
+   by one thread only; copy it before reading it from another */
+
+#define PROFILE_WINDOW 1024    // samples kept per phase
+#define PROFILE_PHASES 16
+
+struct Sim_Profile {
+  const char *label;                          // "sim", "render"
+  int phases;
+  const char *name[PROFILE_PHASES];
+  std::vector<float> sample[PROFILE_PHASES];  // ring of the last samples, us
+  long count[PROFILE_PHASES];
+  double total[PROFILE_PHASES],max[PROFILE_PHASES];
+};
+
+struct Profile_Stats {
+  long count;
+  double mean,p50,p95,p99,max;   // us; percentiles over the window
+};
+
+static inline double Profile_Now()
+{
+  return std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profile_Init(struct Sim_Profile *profile,const char *label,const char *const *names,int phases);
+void Profile_Clear(struct Sim_Profile *profile);
+void Profile_Add(struct Sim_Profile *profile,int phase,double us);
+/* Add the time since *t to phase and restart *t from now. Both do nothing
+   without a profile, so timed code needs no checks of its own */
+static inline double Profile_Start(const struct Sim_Profile *profile)
+{
+  return profile ? Profile_Now() : 0;
+}
+static inline void Profile_Lap(struct Sim_Profile *profile,int phase,double *t)
+{
+  if(!profile)
+    return;
+  double now=Profile_Now();
+  Profile_Add(profile,phase,now-*t);
+  *t=now;
+}
+
+struct Profile_Stats Profile_Get(const struct Sim_Profile *profile,int phase);
+/* Print one line per phase on stdout */
+void Profile_Report(const struct Sim_Profile *profile);
+/* Write the stats of n profiles to path, as JSON if it ends in .json and
+   as CSV otherwise. Returns false if the file could not be written */
+bool Profile_Write(const struct Sim_Profile *const *profiles,int n,const char *path);
+
+#endif
@@ -0,0 +1,268 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Sim_Replay.h"
+#include "Sim_Input.h"
+#include "Simulation.h"
+
+static void put_varint(std::vector<unsigned char> &data,unsigned long long v)
+{
+  while(v>=0x80)
+  {
+    data.push_back((unsigned char)(v|0x80));
+    v>>=7;
+  }
+  data.push_back((unsigned char)v);
+}
+
+static void put_bytes(std::vector<unsigned char> &data,unsigned long long v,int n)
+{
+  for(int k=0;k<n;k++)
+    data.push_back((unsigned char)(v>>(8*k)));
+}
+
+static void put_float(std::vector<unsigned char> &data,float f)
+{
+  unsigned int bits;
+  memcpy(&bits,&f,sizeof(bits));
+  put_bytes(data,bits,4);
+}
+
+/* Readers stop at end and return false instead of running off the map */
+static bool get_varint(const struct Sim_Replay *replay,size_t *pos,unsigned long long *v)
+{
+  *v=0;
+  for(int shift=0;*pos<replay->end && shift<64;shift+=7)
+  {
+    unsigned char byte=replay->data[(*pos)++];
+    *v|=(unsigned long long)(byte&0x7f)<<shift;
+    if(!(byte&0x80))
+      return true;
+  }
+  return false;
+}
+
+static unsigned long long get_bytes(const unsigned char *p,int n)
+{
+  unsigned long long v=0;
+  for(int k=0;k<n;k++)
+    v|=(unsigned long long)p[k]<<(8*k);
+  return v;
+}
+
+static float get_float(const unsigned char *p)
+{
+  unsigned int bits=(unsigned int)get_bytes(p,4);
+  float f;
+  memcpy(&f,&bits,sizeof(f));
+  return f;
+}
+
+/* Payload floats of an event of the given type */
+static int event_floats(int type)
+{
+  if(type==SIM_INPUT_FIRE)
+    return 0;
+  return type==SIM_INPUT_AIM ? 2 : 1;
+}
+
+static void put_double(std::vector<unsigned char> &data,double d)
+{
+  unsigned long long bits;
+  memcpy(&bits,&d,sizeof(bits));
+  put_bytes(data,bits,8);
+}
+
+static double get_double(const unsigned char *p)
+{
+  unsigned long long bits=get_bytes(p,8);
+  double d;
+  memcpy(&d,&bits,sizeof(d));
+  return d;
+}
+
+struct Sim_Recorder *Recorder_Create(const struct Game *game,unsigned int seed)
+{
+  struct Sim_Recorder *recorder=new Sim_Recorder;
+  for(int k=0;k<4;k++)
+    recorder->data.push_back(REPLAY_MAGIC[k]);
+  put_varint(recorder->data,seed);
+  put_double(recorder->data,game->dt);
+  put_varint(recorder->data,game->mirror_count);
+  for(int i=0;i<game->mirror_count;i++)
+  {
+    put_double(recorder->data,game->mirror[i].x_pos);
+    put_double(recorder->data,game->mirror[i].y_pos);
+    put_double(recorder->data,game->mirror[i].angle);
+    put_double(recorder->data,game->mirror[i].a);
+  }
+  recorder->last_tick=0;
+  return recorder;
+}
+
+void Recorder_Event(struct Sim_Recorder *recorder,long tick,const struct Sim_Input_Event *event)
+{
+  long delta=tick-recorder->last_tick;
+  put_varint(recorder->data,delta<0 ? ((unsigned long long)-delta<<1)-1 : (unsigned long long)delta<<1);
+  recorder->last_tick=tick;
+  recorder->data.push_back((unsigned char)(event->type|event->target<<4));
+  int floats=event_floats(event->type);
+  if(floats>0)
+    put_float(recorder->data,event->x);
+  if(floats>1)
+    put_float(recorder->data,event->y);
+}
+
+bool Recorder_Close(struct Sim_Recorder *recorder,const struct Game *game,const char *path)
+{
+  put_bytes(recorder->data,game->tick,8);
+  put_bytes(recorder->data,(unsigned int)game->Score,4);
+  put_bytes(recorder->data,Sim_Hash(game),8);
+  FILE *file=fopen(path,"wb");
+  bool ok=file && fwrite(recorder->data.data(),1,recorder->data.size(),file)==recorder->data.size();
+  if(file && fclose(file)!=0)
+    ok=false;
+  if(!ok)
+    std::cerr << "Cannot write replay " << path << std::endl;
+  delete recorder;
+  return ok;
+}
+
+/* Decode the tick delta of the next event, if any */
+static void next_event(struct Sim_Replay *replay)
+{
+  unsigned long long delta;
+  size_t pos=replay->pos;
+  if(pos<replay->end && get_varint(replay,&pos,&delta))
+  {
+    replay->pos=pos;
+    replay->next_tick+=delta&1 ? -(long)(delta>>1)-1 : (long)(delta>>1);
+  }
+  else
+    replay->next_tick=-1;
+}
+
+struct Sim_Replay *Replay_Open(const char *path)
+{
+  int fd=open(path,O_RDONLY);
+  if(fd<0)
+  {
+    std::cerr << "Cannot open replay " << path << std::endl;
+    return NULL;
+  }
+  struct stat info;
+  void *map=MAP_FAILED;
+  if(fstat(fd,&info)==0 && info.st_size>0)
+    map=mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if(map==MAP_FAILED)
+  {
+    std::cerr << "Cannot map replay " << path << std::endl;
+    return NULL;
+  }
+  struct Sim_Replay *replay=new Sim_Replay;
+  replay->data=(const unsigned char *)map;
+  replay->size=info.st_size;
+  replay->end=replay->size>=REPLAY_TRAILER ? replay->size-REPLAY_TRAILER : 0;
+  replay->pos=4;
+  unsigned long long seed,mirrors=0;
+  bool ok=replay->size>=4+1+8+1+REPLAY_TRAILER && memcmp(replay->data,REPLAY_MAGIC,4)==0
+    && get_varint(replay,&replay->pos,&seed) && replay->pos+8<=replay->end;
+  if(ok)
+  {
+    replay->dt=get_double(replay->data+replay->pos);
+    replay->pos+=8;
+    ok=get_varint(replay,&replay->pos,&mirrors) && mirrors<=(replay->end-replay->pos)/32;
+  }
+  if(!ok)
+  {
+    std::cerr << path << " is not a replay" << std::endl;
+    Replay_Close(replay);
+    return NULL;
+  }
+  replay->seed=(unsigned int)seed;
+  replay->mirror_count=(int)mirrors;
+  replay->mirrors=replay->pos;
+  replay->pos+=32*mirrors;
+  const unsigned char *trailer=replay->data+replay->end;
+  replay->end_tick=(long)get_bytes(trailer,8);
+  replay->score=(int)get_bytes(trailer+8,4);
+  replay->hash=get_bytes(trailer+12,8);
+  return replay;
+}
+
+void Replay_Close(struct Sim_Replay *replay)
+{
+  if(!replay)
+    return;
+  munmap((void *)replay->data,replay->size);
+  delete replay;
+}
+
+void Replay_Start(struct Sim_Replay *replay,struct Game *game)
+{
+  Sim_Init(game,replay->seed);
+  Sim_Set_Tick(game,replay->dt);
+  Sim_Clear_Mirrors(game);
+  for(int i=0;i<replay->mirror_count;i++)
+  {
+    const unsigned char *p=replay->data+replay->mirrors+32*i;
+    Sim_Add_Mirror(game,get_double(p),get_double(p+8),get_double(p+16),get_double(p+24));
+  }
+  Sim_Build_Mirrors(game);
+  game->replay=replay;
+  replay->pos=replay->mirrors+32*replay->mirror_count;
+  replay->next_tick=0;
+  next_event(replay);
+}
+
+void Replay_Apply(struct Sim_Replay *replay,struct Game *game)
+{
+  while(replay->next_tick>=0 && replay->next_tick<=game->tick)
+  {
+    struct Sim_Input_Event event;
+    if(replay->pos>=replay->end)
+    {
+      replay->next_tick=-1;
+      break;
+    }
+    unsigned char code=replay->data[replay->pos++];
+    event.time=game->sim_time;
+    event.type=code&15;
+    event.target=code>>4;
+    event.x=event.y=0;
+    int floats=event_floats(event.type);
+    if(replay->pos+4*floats>replay->end)
+    {
+      replay->next_tick=-1;
+      break;
+    }
+    if(floats>0)
+      event.x=get_float(replay->data+replay->pos);
+    if(floats>1)
+      event.y=get_float(replay->data+replay->pos+4);
+    replay->pos+=4*floats;
+    if(event.target<2)
+      Sim_Apply_Input(game,&event);
+    next_event(replay);
+  }
+}
+
+bool Replay_Done(const struct Sim_Replay *replay,const struct Game *game)
+{
+  return replay->next_tick<0 && game->tick>=replay->end_tick;
+}
+
+bool Replay_Check(const struct Sim_Replay *replay,const struct Game *game)
+{
+  bool match=game->tick==replay->end_tick && game->Score==replay->score && Sim_Hash(game)==replay->hash;
+  std::cout << "Replay: " << (match ? "match" : "MISMATCH") << " at tick " << game->tick
+            << " (recorded " << replay->end_tick << "), score " << game->Score
+            << " (recorded " << replay->score << ")" << std::endl;
+  return match;
+}
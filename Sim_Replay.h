@@ -0,0 +1,73 @@
+#ifndef SIM_REPLAY_H
+#define SIM_REPLAY_H
+
+#include <cstddef>
+#include <vector>
+
+struct Game;
+struct Sim_Input_Event;
+
+/* A game is fully determined by its seed, its tick length, its level and
+   the input applied on each tick, so that is all a replay file stores:
+
+     "BBR3" varint(seed) f64(dt)
+     varint(mirrors) per mirror: f64(x) f64(y) f64(angle) f64(length)
+     per event:  zigzag varint(tick - previous event tick) u8(type | target<<4)
+                 f32(x) [f32(y) for SIM_INPUT_AIM], nothing for SIM_INPUT_FIRE
+     trailer:    i64(end tick) i32(score) u64(Sim_Hash)   (REPLAY_TRAILER bytes)
+
+   Numbers are little endian; varints are LEB128. The tick delta is signed
+   because a rewind moves the game back. Events are usually 6 bytes. The
+   trailer lets playback check that it ended bit-exactly where the
+   recording did. A game that rewinds plays back the same only with a
+   Sim_Rewind of the same size attached */
+
+#define REPLAY_MAGIC "BBR3"
+#define REPLAY_TRAILER 20
+
+/* Collects the file in memory; written out by Recorder_Close */
+struct Sim_Recorder {
+  std::vector<unsigned char> data;
+  long last_tick;
+};
+
+/* A replay file mapped read-only; events are decoded in place as the game
+   reaches their tick */
+struct Sim_Replay {
+  const unsigned char *data;
+  size_t size;
+  size_t pos;              // next event byte
+  size_t mirrors;          // first mirror byte
+  int mirror_count;
+  size_t end;              // start of the trailer
+  long next_tick;          // tick of the event at pos, -1 after the last one
+  unsigned int seed;
+  double dt;
+  long end_tick;
+  int score;
+  unsigned long long hash;
+};
+
+/* Start recording a game initialized with seed, with game's tick length
+   and level; attach the result to game->recorder */
+struct Sim_Recorder *Recorder_Create(const struct Game *game,unsigned int seed);
+void Recorder_Event(struct Sim_Recorder *recorder,long tick,const struct Sim_Input_Event *event);
+/* Append the trailer for the current state of game, write the file and free
+   the recorder. Returns false if the file could not be written */
+bool Recorder_Close(struct Sim_Recorder *recorder,const struct Game *game,const char *path);
+
+/* Map a replay file; NULL if it cannot be read or is not a replay */
+struct Sim_Replay *Replay_Open(const char *path);
+void Replay_Close(struct Sim_Replay *replay);
+/* Sim_Init/Sim_Set_Tick the game and set up its level from the replay,
+   and attach it */
+void Replay_Start(struct Sim_Replay *replay,struct Game *game);
+/* Apply the events recorded for game->tick (called by Sim_Step) */
+void Replay_Apply(struct Sim_Replay *replay,struct Game *game);
+/* True once every event was applied and the game reached the end tick */
+bool Replay_Done(const struct Sim_Replay *replay,const struct Game *game);
+/* Compare the game with the recorded end state and report it on stdout;
+   returns true on an exact match */
+bool Replay_Check(const struct Sim_Replay *replay,const struct Game *game);
+
+#endif
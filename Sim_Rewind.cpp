@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <iostream>
+#include <type_traits>
+
+#include "Sim_Rewind.h"
+
+static_assert(std::is_trivially_copyable<struct Sim_State>::value,"Sim_State must stay a plain block");
+
+void Rewind_Init(struct Sim_Rewind *rewind,int frames,int max_bricks,int max_bullets)
+{
+  rewind->frames=frames<1 ? 1 : frames;
+  rewind->max_bricks=max_bricks;
+  rewind->max_bullets=max_bullets;
+  rewind->state.assign(rewind->frames,Sim_State());
+  size_t bricks=(size_t)rewind->frames*max_bricks,bullets=(size_t)rewind->frames*max_bullets;
+  rewind->brick_x.assign(bricks,0);
+  rewind->brick_y.assign(bricks,0);
+  rewind->brick_a.assign(bricks,0);
+  rewind->brick_b.assign(bricks,0);
+  rewind->brick_color.assign(bricks,0);
+  rewind->bullet_x.assign(bullets,0);
+  rewind->bullet_y.assign(bullets,0);
+  rewind->bullet_dx.assign(bullets,0);
+  rewind->bullet_dy.assign(bullets,0);
+  rewind->bullet_vx.assign(bullets,0);
+  rewind->bullet_vy.assign(bullets,0);
+  rewind->bullet_a.assign(bullets,0);
+  rewind->bullet_b.assign(bullets,0);
+  rewind->saved=rewind->grown=0;
+  Rewind_Clear(rewind);
+}
+
+/* Lay a per-frame array out again with room for to entities per frame
+   instead of from, keeping the frames already written */
+template <typename T> static void regrow(std::vector<T> &v,int frames,int from,int to)
+{
+  std::vector<T> grown((size_t)frames*to);
+  for(int f=0;f<frames;f++)
+    std::copy(v.begin()+(size_t)f*from,v.begin()+(size_t)(f+1)*from,grown.begin()+(size_t)f*to);
+  v.swap(grown);
+}
+
+/* Make room for n bricks and m bullets in every frame, at least doubling
+   what grows so a growing game only pays for it a few times */
+static void grow(struct Sim_Rewind *rewind,int n,int m)
+{
+  int frames=rewind->frames;
+  if(n>rewind->max_bricks)
+  {
+    int to=std::max(n,2*rewind->max_bricks);
+    regrow(rewind->brick_x,frames,rewind->max_bricks,to);
+    regrow(rewind->brick_y,frames,rewind->max_bricks,to);
+    regrow(rewind->brick_a,frames,rewind->max_bricks,to);
+    regrow(rewind->brick_b,frames,rewind->max_bricks,to);
+    regrow(rewind->brick_color,frames,rewind->max_bricks,to);
+    rewind->max_bricks=to;
+  }
+  if(m>rewind->max_bullets)
+  {
+    int to=std::max(m,2*rewind->max_bullets);
+    regrow(rewind->bullet_x,frames,rewind->max_bullets,to);
+    regrow(rewind->bullet_y,frames,rewind->max_bullets,to);
+    regrow(rewind->bullet_dx,frames,rewind->max_bullets,to);
+    regrow(rewind->bullet_dy,frames,rewind->max_bullets,to);
+    regrow(rewind->bullet_vx,frames,rewind->max_bullets,to);
+    regrow(rewind->bullet_vy,frames,rewind->max_bullets,to);
+    regrow(rewind->bullet_a,frames,rewind->max_bullets,to);
+    regrow(rewind->bullet_b,frames,rewind->max_bullets,to);
+    rewind->max_bullets=to;
+  }
+  rewind->grown++;
+}
+
+void Rewind_Clear(struct Sim_Rewind *rewind)
+{
+  rewind->head=0;
+  rewind->count=0;
+}
+
+void Rewind_Save(struct Sim_Rewind *rewind,const struct Game *game)
+{
+  const struct Sim_Bricks &bricks=game->bricks;
+  const struct Sim_Bullets &bullets=game->bullets;
+  int f=rewind->head;
+  struct Sim_State &state=rewind->state[f];
+  state.bin[0]=game->bin[0];
+  state.bin[1]=game->bin[1];
+  state.gun=game->gun;
+  state.Speed_of_Brick=game->Speed_of_Brick;
+  state.time_to_hit_space=game->time_to_hit_space;
+  state.tick=game->tick;
+  state.Score=game->Score;
+  state.rng=game->rng;
+  state.game_over=game->game_over;
+  int n=bricks.pool.count,m=bullets.pool.count;
+  if(n>rewind->max_bricks || m>rewind->max_bullets)
+    grow(rewind,n,m);
+  size_t b=(size_t)f*rewind->max_bricks,u=(size_t)f*rewind->max_bullets;
+  std::copy(bricks.x_pos.begin(),bricks.x_pos.begin()+n,rewind->brick_x.begin()+b);
+  std::copy(bricks.y_pos.begin(),bricks.y_pos.begin()+n,rewind->brick_y.begin()+b);
+  std::copy(bricks.a.begin(),bricks.a.begin()+n,rewind->brick_a.begin()+b);
+  std::copy(bricks.b.begin(),bricks.b.begin()+n,rewind->brick_b.begin()+b);
+  std::copy(bricks.color.begin(),bricks.color.begin()+n,rewind->brick_color.begin()+b);
+  std::copy(bullets.x_pos.begin(),bullets.x_pos.begin()+m,rewind->bullet_x.begin()+u);
+  std::copy(bullets.y_pos.begin(),bullets.y_pos.begin()+m,rewind->bullet_y.begin()+u);
+  std::copy(bullets.dx.begin(),bullets.dx.begin()+m,rewind->bullet_dx.begin()+u);
+  std::copy(bullets.dy.begin(),bullets.dy.begin()+m,rewind->bullet_dy.begin()+u);
+  std::copy(bullets.vx.begin(),bullets.vx.begin()+m,rewind->bullet_vx.begin()+u);
+  std::copy(bullets.vy.begin(),bullets.vy.begin()+m,rewind->bullet_vy.begin()+u);
+  std::copy(bullets.a.begin(),bullets.a.begin()+m,rewind->bullet_a.begin()+u);
+  std::copy(bullets.b.begin(),bullets.b.begin()+m,rewind->bullet_b.begin()+u);
+  state.brick_count=n;
+  state.bullet_count=m;
+  rewind->head=(f+1)%rewind->frames;
+  if(rewind->count<rewind->frames)
+    rewind->count++;
+  rewind->saved++;
+}
+
+long Rewind_Restore(struct Sim_Rewind *rewind,struct Game *game,long tick)
+{
+  if(rewind->count==0)
+    return -1;
+  // frames hold consecutive ticks, newest at head-1
+  int frames=rewind->frames;
+  long back=rewind->state[(rewind->head+frames-1)%frames].tick-tick;
+  int k=back<0 ? 0 : back>rewind->count-1 ? rewind->count-1 : (int)back;
+  int f=(rewind->head+frames-1-k)%frames;
+  const struct Sim_State &state=rewind->state[f];
+  rewind->head=(f+1)%frames;
+  rewind->count-=k;
+
+  game->bin[0]=state.bin[0];
+  game->bin[1]=state.bin[1];
+  game->gun=state.gun;
+  game->Speed_of_Brick=state.Speed_of_Brick;
+  game->time_to_hit_space=state.time_to_hit_space;
+  game->tick=state.tick;
+  game->sim_time=state.tick*game->dt;
+  game->Score=state.Score;
+  game->rng=state.rng;
+  game->game_over=state.game_over;
+
+  struct Sim_Bricks &bricks=game->bricks;
+  struct Sim_Bullets &bullets=game->bullets;
+  Pool_Clear(&bricks.pool);
+  bricks.x_pos.clear();bricks.y_pos.clear();bricks.a.clear();bricks.b.clear();bricks.color.clear();
+  Pool_Clear(&bullets.pool);
+  bullets.x_pos.clear();bullets.y_pos.clear();bullets.dx.clear();bullets.dy.clear();
+  bullets.vx.clear();bullets.vy.clear();bullets.a.clear();bullets.b.clear();
+  size_t b=(size_t)f*rewind->max_bricks,u=(size_t)f*rewind->max_bullets;
+  // added through the pools for fresh handles, then every field copied back
+  for(int i=0;i<state.brick_count;i++)
+    Sim_Add_Brick(game,rewind->brick_x[b+i],rewind->brick_y[b+i],rewind->brick_color[b+i]);
+  std::copy(rewind->brick_a.begin()+b,rewind->brick_a.begin()+b+state.brick_count,bricks.a.begin());
+  std::copy(rewind->brick_b.begin()+b,rewind->brick_b.begin()+b+state.brick_count,bricks.b.begin());
+  for(int i=0;i<state.bullet_count;i++)
+    Sim_Add_Bullet(game,rewind->bullet_x[u+i],rewind->bullet_y[u+i],rewind->bullet_dx[u+i],rewind->bullet_dy[u+i]);
+  std::copy(rewind->bullet_vx.begin()+u,rewind->bullet_vx.begin()+u+state.bullet_count,bullets.vx.begin());
+  std::copy(rewind->bullet_vy.begin()+u,rewind->bullet_vy.begin()+u+state.bullet_count,bullets.vy.begin());
+  std::copy(rewind->bullet_a.begin()+u,rewind->bullet_a.begin()+u+state.bullet_count,bullets.a.begin());
+  std::copy(rewind->bullet_b.begin()+u,rewind->bullet_b.begin()+u+state.bullet_count,bullets.b.begin());
+  return state.tick;
+}
+
+void Rewind_Report(const struct Sim_Rewind *rewind)
+{
+  std::cout << "Rewind: " << rewind->frames << " frames, " << rewind->saved << " saved, grown "
+            << rewind->grown << " times, room for " << rewind->max_bricks << " bricks and "
+            << rewind->max_bullets << " bullets per frame" << std::endl;
+}
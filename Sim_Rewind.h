@@ -0,0 +1,65 @@
+#ifndef SIM_REWIND_H
+#define SIM_REWIND_H
+
+#include <vector>
+
+#include "Simulation.h"
+
+/* Rewind: the state at the end of each of the last few seconds of ticks is
+   kept in a fixed ring of frames, so the game can be put back to any of
+   them. Everything is allocated by Rewind_Init; saving a frame is a few
+   flat copies of every brick and bullet field. A frame with more entities
+   than the ring was sized for grows it for all frames, once, so every tick
+   is kept. Its cost is the rewind phase of a Sim_Profile.
+
+   Limits:
+   - saving and restoring are O(entities), not O(1): only the scalar part
+     of the game (Sim_State) is one trivially copyable block, the pools
+     are copied field by field
+   - restoring empties both pools and adds the entities back, so every
+     Sim_Handle issued before a restore is stale afterwards (Pool_Find
+     returns -1), even for an entity that exists in the restored frame */
+
+#define REWIND_SECONDS 5
+#define REWIND_MAX_BRICKS 1024    // initial room per frame; grown when exceeded
+#define REWIND_MAX_BULLETS 256
+
+/* The scalar part of struct Game, as one trivially copyable block */
+struct Sim_State {
+  struct Sim_Bin bin[2];
+  struct Sim_Gun gun;
+  double Speed_of_Brick;
+  double time_to_hit_space;
+  long tick;
+  int Score;
+  unsigned int rng;
+  bool game_over;
+  int brick_count,bullet_count;
+};
+
+struct Sim_Rewind {
+  int frames,max_bricks,max_bullets;
+  int head;                  // next frame to write
+  int count;                 // frames written, up to frames
+  std::vector<struct Sim_State> state;
+  // per frame, indexed [frame*max_bricks+i] and [frame*max_bullets+i]
+  std::vector<float> brick_x,brick_y,brick_a,brick_b;
+  std::vector<int> brick_color;
+  std::vector<float> bullet_x,bullet_y,bullet_dx,bullet_dy,bullet_vx,bullet_vy,bullet_a,bullet_b;
+  long saved,grown;
+};
+
+void Rewind_Init(struct Sim_Rewind *rewind,int frames,int max_bricks,int max_bullets);
+/* Forget all frames (a new game) */
+void Rewind_Clear(struct Sim_Rewind *rewind);
+/* Keep the state at the end of the current tick (called by Sim_Step) */
+void Rewind_Save(struct Sim_Rewind *rewind,const struct Game *game);
+/* Put the game back to the end of tick, or of the oldest tick kept if tick
+   is older, and drop the frames after it. Finding the frame is O(1); the
+   copy is O(entities) and leaves every earlier brick and bullet handle
+   stale. Returns the tick restored, or -1 if there is no frame */
+long Rewind_Restore(struct Sim_Rewind *rewind,struct Game *game,long tick);
+/* Print how many frames were saved and how far the ring grew on stdout */
+void Rewind_Report(const struct Sim_Rewind *rewind);
+
+#endif
@@ -0,0 +1,662 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Simulation.h"
+#include "Sim_Kernel.h"
+#include "Thread_Pool.h"
+#include "Sim_Input.h"
+#include "Sim_Replay.h"
+#include "Sim_Rewind.h"
+#include "Sim_Profile.h"
+
+const char *const sim_phase_name[SIM_PHASES]={
+  "input","catch","grid","bullets","reflection","fall","spawn","retire","rewind","tick"
+};
+
+static void CreateBin(struct Sim_Bin *bin,int c,double x_pos,double y_pos)
+{
+  bin->bin_height=1;bin->bin_width=0.8;
+  bin->color=c;
+  bin->x_pos=x_pos;bin->y_pos=y_pos;
+}
+
+static void CreateGun(struct Sim_Gun *gun)
+{
+  gun->rect1.a=0.4;gun->rect1.b=0.4;gun->rect1.color=3;
+  gun->rect2.a=0.6;gun->rect2.b=0.2;gun->rect2.color=3;
+  gun->x_pos=-3.5;
+  gun->y_pos=0;
+  gun->rot_angle=0;
+}
+
+/* The default level */
+static void CreateMirror(struct Game *game)
+{
+  Sim_Add_Mirror(game,3,-1.5,-135,1.2);
+  Sim_Add_Mirror(game,3,1.5,135,1.2);
+  Sim_Add_Mirror(game,3.5,0,90,1.2);
+  Sim_Build_Mirrors(game);
+}
+
+void Sim_Clear_Mirrors(struct Game *game)
+{
+  game->mirror.clear();
+  game->mirror_x1.clear();game->mirror_y1.clear();
+  game->mirror_x2.clear();game->mirror_y2.clear();
+  game->mirror_nx.clear();game->mirror_ny.clear();
+  game->mirror_count=0;
+  Sim_Build_Mirrors(game);
+}
+
+void Sim_Add_Mirror(struct Game *game,double x_pos,double y_pos,double angle,double length)
+{
+  struct Sim_Body mirror;
+  mirror.a=length;mirror.b=0.05;
+  mirror.x_pos=x_pos;mirror.y_pos=y_pos;mirror.angle=angle;
+  mirror.color=3;
+  game->mirror.push_back(mirror);
+  game->mirror_x1.push_back(x_pos-length/2*cos(angle*M_PI/180.0f));
+  game->mirror_y1.push_back(y_pos-length/2*sin(angle*M_PI/180.0f));
+  game->mirror_x2.push_back(x_pos+length/2*cos(angle*M_PI/180.0f));
+  game->mirror_y2.push_back(y_pos+length/2*sin(angle*M_PI/180.0f));
+  game->mirror_nx.push_back(-sin(angle*M_PI/180.0f));
+  game->mirror_ny.push_back(cos(angle*M_PI/180.0f));
+  game->mirror_count=game->mirror.size();
+}
+
+void Sim_Copy_Mirrors(struct Game *game,const struct Game *from)
+{
+  game->mirror=from->mirror;
+  game->mirror_x1=from->mirror_x1;game->mirror_y1=from->mirror_y1;
+  game->mirror_x2=from->mirror_x2;game->mirror_y2=from->mirror_y2;
+  game->mirror_nx=from->mirror_nx;game->mirror_ny=from->mirror_ny;
+  game->mirror_count=from->mirror_count;
+  game->mirror_bvh=from->mirror_bvh;
+}
+
+void Sim_Build_Mirrors(struct Game *game)
+{
+  BVH_Build(&game->mirror_bvh,game->mirror_x1.data(),game->mirror_y1.data(),
+    game->mirror_x2.data(),game->mirror_y2.data(),game->mirror_count);
+}
+
+bool Sim_Load_Level(struct Game *game,const char *path)
+{
+  FILE *file=fopen(path,"r");
+  if(!file)
+    return false;
+  char line[256];
+  double x_pos,y_pos,angle,length;
+  Sim_Clear_Mirrors(game);
+  while(fgets(line,sizeof(line),file))
+    if(line[0]!='#' && sscanf(line,"%lf %lf %lf %lf",&x_pos,&y_pos,&angle,&length)==4)
+      Sim_Add_Mirror(game,x_pos,y_pos,angle,length);
+  fclose(file);
+  Sim_Build_Mirrors(game);
+  return true;
+}
+
+void Sim_Scatter_Mirrors(struct Game *game,int n,unsigned int seed)
+{
+  unsigned int rng=Sim_Seed(seed,2);
+  Sim_Clear_Mirrors(game);
+  // right of the gun, clear of the bins' paths below -1.5
+  for(int i=0;i<n;i++)
+  {
+    double x_pos=-2.5+(Sim_Rand(&rng)%6001)/1000.0;
+    double y_pos=-1+(Sim_Rand(&rng)%4501)/1000.0;
+    Sim_Add_Mirror(game,x_pos,y_pos,Sim_Rand(&rng)%180,0.3);
+  }
+  Sim_Build_Mirrors(game);
+}
+
+unsigned int Sim_Seed(unsigned int seed,unsigned int stream)
+{
+  // spread consecutive seeds and streams over the whole state space
+  unsigned int h=seed*0x9E3779B9u+stream*0x85EBCA6Bu;
+  h^=h>>16;h*=0x7FEB352Du;h^=h>>15;h*=0x846CA68Bu;h^=h>>16;
+  return h ? h : 1;
+}
+
+void Sim_Init(struct Game *game,unsigned int seed)
+{
+  *game=Game();
+  game->rng=Sim_Seed(seed,0);
+  CreateBin(&game->bin[0],1,0,-2.5);
+  CreateBin(&game->bin[1],0,1,-2.5);
+  CreateGun(&game->gun);
+  CreateMirror(game);
+  game->Speed_of_Brick=0.01;
+  Sim_Set_Tick(game,SIM_DT);
+}
+
+void Sim_Set_Tick(struct Game *game,double dt)
+{
+  game->dt=dt;
+  game->spawn_ticks=(int)(BRICK_SPAWN_TIME/dt+0.5);
+  if(game->spawn_ticks<1)
+    game->spawn_ticks=1;
+}
+
+struct Sim_Handle Pool_Insert(struct Sim_Pool *pool)
+{
+  struct Sim_Handle handle;
+  if(!pool->free_slots.empty())
+  {
+    handle.index=pool->free_slots.back();
+    pool->free_slots.pop_back();
+  }
+  else
+  {
+    handle.index=pool->dense_of_slot.size();
+    pool->dense_of_slot.push_back(0);
+    pool->generation.push_back(0);
+  }
+  handle.generation=pool->generation[handle.index];
+  pool->dense_of_slot[handle.index]=pool->count;
+  pool->slot_of_dense.push_back(handle.index);
+  pool->count++;
+  return handle;
+}
+
+int Pool_Find(const struct Sim_Pool *pool,struct Sim_Handle handle)
+{
+  if(handle.index>=pool->generation.size() || pool->generation[handle.index]!=handle.generation)
+    return -1;
+  return pool->dense_of_slot[handle.index];
+}
+
+int Pool_Remove(struct Sim_Pool *pool,int i)
+{
+  int last=pool->count-1;
+  unsigned int slot=pool->slot_of_dense[i];
+  unsigned int moved=pool->slot_of_dense[last];
+  pool->generation[slot]++;
+  pool->free_slots.push_back(slot);
+  pool->slot_of_dense[i]=moved;
+  pool->dense_of_slot[moved]=i;
+  pool->slot_of_dense.pop_back();
+  pool->count=last;
+  return last;
+}
+
+void Pool_Clear(struct Sim_Pool *pool)
+{
+  pool->free_slots.clear();
+  for(size_t slot=pool->generation.size();slot-->0;)
+  {
+    pool->generation[slot]++;
+    pool->free_slots.push_back(slot);   // slot 0 is reused first
+  }
+  pool->slot_of_dense.clear();
+  pool->count=0;
+}
+
+struct Sim_Handle Sim_Add_Brick(struct Game *game,float x_pos,float y_pos,int color)
+{
+  struct Sim_Bricks &bricks=game->bricks;
+  struct Sim_Handle handle=Pool_Insert(&bricks.pool);
+  bricks.x_pos.push_back(x_pos);
+  bricks.y_pos.push_back(y_pos);
+  bricks.a.push_back(0.2);
+  bricks.b.push_back(0.4);
+  bricks.color.push_back(color);
+  return handle;
+}
+
+void Sim_Remove_Brick(struct Game *game,int i)
+{
+  struct Sim_Bricks &bricks=game->bricks;
+  int last=Pool_Remove(&bricks.pool,i);
+  bricks.x_pos[i]=bricks.x_pos[last];bricks.x_pos.pop_back();
+  bricks.y_pos[i]=bricks.y_pos[last];bricks.y_pos.pop_back();
+  bricks.a[i]=bricks.a[last];bricks.a.pop_back();
+  bricks.b[i]=bricks.b[last];bricks.b.pop_back();
+  bricks.color[i]=bricks.color[last];bricks.color.pop_back();
+}
+
+struct Sim_Handle Sim_Add_Bullet(struct Game *game,float x_pos,float y_pos,float dx,float dy)
+{
+  struct Sim_Bullets &bullets=game->bullets;
+  struct Sim_Handle handle=Pool_Insert(&bullets.pool);
+  bullets.x_pos.push_back(x_pos);
+  bullets.y_pos.push_back(y_pos);
+  bullets.dx.push_back(dx);
+  bullets.dy.push_back(dy);
+  bullets.vx.push_back(BULLET_SPEED*dx);
+  bullets.vy.push_back(BULLET_SPEED*dy);
+  bullets.a.push_back(game->gun.rect2.b/3);
+  bullets.b.push_back(BULLET_LENGTH);
+  return handle;
+}
+
+void Sim_Remove_Bullet(struct Game *game,int i)
+{
+  struct Sim_Bullets &bullets=game->bullets;
+  int last=Pool_Remove(&bullets.pool,i);
+  bullets.x_pos[i]=bullets.x_pos[last];bullets.x_pos.pop_back();
+  bullets.y_pos[i]=bullets.y_pos[last];bullets.y_pos.pop_back();
+  bullets.dx[i]=bullets.dx[last];bullets.dx.pop_back();
+  bullets.dy[i]=bullets.dy[last];bullets.dy.pop_back();
+  bullets.vx[i]=bullets.vx[last];bullets.vx.pop_back();
+  bullets.vy[i]=bullets.vy[last];bullets.vy.pop_back();
+  bullets.a[i]=bullets.a[last];bullets.a.pop_back();
+  bullets.b[i]=bullets.b[last];bullets.b.pop_back();
+}
+
+void CreateBrick(struct Game *game)
+{
+  float x_pos=((int)(Sim_Rand(&game->rng)%11)-5)/2.5;
+  int color=Sim_Rand(&game->rng)%3;
+  if(color==2)
+  color++;
+  Sim_Add_Brick(game,x_pos,4.0,color);
+}
+
+void CreateBullet(struct Game *game)
+{
+  struct Sim_Gun &gun=game->gun;
+  double gun_length = gun.rect1.a+gun.rect2.a;
+  double dx=cos((gun.rot_angle)*M_PI/180.0f),dy=sin((gun.rot_angle)*M_PI/180.0f);
+  Sim_Add_Bullet(game,-gun.rect1.a/2+gun.x_pos+gun_length*dx,-gun.rect1.b/2+gun.y_pos+gun_length*dy,dx,dy);
+}
+
+void Sim_Populate(struct Game *game,int n)
+{
+  for(int i=0;i<n;i++)
+  {
+    int color=Sim_Rand(&game->rng)%3;
+    if(color==2)
+    color++;
+    float x_pos=((int)(Sim_Rand(&game->rng)%8001)-4000)/1000.0;
+    float y_pos=((int)(Sim_Rand(&game->rng)%8001)-4000)/1000.0;
+    Sim_Add_Brick(game,x_pos,y_pos,color);
+  }
+}
+
+bool Sim_Can_Fire(const struct Game *game)
+{
+  return game->sim_time-game->time_to_hit_space>=RELOAD_TIME;
+}
+
+bool Sim_Fire(struct Game *game)
+{
+  if(!Sim_Can_Fire(game))
+    return false;
+  CreateBullet(game);
+  game->time_to_hit_space=game->sim_time;
+  return true;
+}
+
+/* Catch the bricks in [begin,end) that lie inside the bin; adds to *score
+   and sets *lost when a black brick is caught */
+static void bin_collection(struct Game *game,const struct Sim_Bin *bin,int begin,int end,int *score,int *lost)
+{
+  struct Sim_Bricks &bricks=game->bricks;
+  const float top=bin->y_pos,bottom=bin->y_pos-bin->bin_height;
+  const float left=bin->x_pos-bin->bin_width/2,right=bin->x_pos+bin->bin_width/2;
+  const int bin_color=bin->color;
+  const float *x_pos=bricks.x_pos.data(),*y_pos=bricks.y_pos.data();
+  const float *a=bricks.a.data(),*b=bricks.b.data();
+  int *colors=bricks.color.data();
+  int caught_score=0,caught_black=0;
+  // branch-free so the loop vectorizes; caught bricks become -1 tombstones
+  for(int j=begin;j<end;j++)
+  {
+    int color=colors[j];
+    int caught=(color!=-1)
+      & (y_pos[j]<=top) & (y_pos[j]-b[j]>=bottom)
+      & (x_pos[j]-a[j]/2>=left) & (x_pos[j]+a[j]/2<=right);
+    caught_score+=caught & (color==bin_color);
+    caught_black|=caught & (color==3);
+    colors[j]=caught ? -1 : color;
+  }
+  *score+=caught_score;
+  *lost|=caught_black;
+}
+
+/* Time of impact of a bullet head moving from (hx,hy) by s along (dx,dy)
+   against the mirrors: returns the first mirror crossed (skipping mirror
+   skip, the one just bounced off) and its distance along the path in *u,
+   or -1 if the path reaches no mirror */
+static int reflection(const struct Game *game,float hx,float hy,float dx,float dy,float s,int skip,float *u)
+{
+  return BVH_First_Hit(&game->mirror_bvh,hx,hy,dx,dy,s,skip,u);
+}
+
+#define HIT_BATCH 256
+
+/* Test one bullet segment against the bricks (vertical segments along their
+   centre line) in the grid cells its bounding box covers and append the hit
+   bricks to hits. Bricks are only destroyed when the hits are merged, so this
+   can run for many bullets at once. A brick binned in several cells may be
+   reported twice, which is harmless as a tombstone no longer scores */
+static void hit_bricks(const struct Sim_Grid &grid,std::vector<int> &hits,float x3,float y3,float x4,float y4)
+{
+  int cx0,cy0,cx1,cy1;
+  unsigned int mask[HIT_BATCH/32];
+  if(!Grid_Cells(fminf(x3,x4),fminf(y3,y4),fmaxf(x3,x4),fmaxf(y3,y4),&cx0,&cy0,&cx1,&cy1))
+    return;
+  for(int cy=cy0;cy<=cy1;cy++)
+  {
+    int begin=grid.cell_start[cy*GRID_DIM+cx0],end=grid.cell_start[cy*GRID_DIM+cx1+1];
+    for(int k=begin;k<end;k+=HIT_BATCH)
+    {
+      int n=end-k<HIT_BATCH ? end-k : HIT_BATCH;
+      const float *x_pos=grid.x_pos.data()+k;
+      Segment_Hits(x_pos,grid.y_top.data()+k,x_pos,grid.y_bottom.data()+k,n,x3,y3,x4,y4,mask);
+      for(int w=0;w<(n+31)/32;w++)
+        for(unsigned int m=mask[w];m;m&=m-1)
+          hits.push_back(grid.item[k+w*32+__builtin_ctz(m)]);
+    }
+  }
+}
+
+#define REFLECT_SAMPLE 16   // profiled: bullets per sampled one
+
+/* Continuous collision: the bullet head sweeps its whole path for the tick,
+   leg by leg between mirror bounces. Each leg hits the bricks along the
+   swept segment (the bullet body from -0.1b behind the tail to 0.1b past
+   the head), so nothing is skipped however far a tick moves the bullet.
+   Runs on BULLET_CHUNK bullets at a time, possibly on several threads; each
+   chunk only writes its own bullets and its own hit list. When profiled,
+   the legs of one bullet in REFLECT_SAMPLE are kept for collision() to
+   time their mirror queries, so no clock is read inside the loop */
+static void move_bullets(int chunk,void *arg)
+{
+  struct Game *game=(struct Game *)arg;
+  struct Sim_Bullets &bullets=game->bullets;
+  std::vector<int> &hits=game->chunk_hits[chunk];
+  int begin=chunk*BULLET_CHUNK,end=std::min(begin+BULLET_CHUNK,bullets.pool.count);
+  std::vector<struct Sim_Leg> &legs=game->chunk_legs[chunk];
+  bool profiled=game->profile!=NULL;
+  hits.clear();
+  legs.clear();
+  for(int t2=begin;t2<end;t2++)
+  {
+    bool sample=profiled && (t2-begin)%REFLECT_SAMPLE==0;
+    float dx=bullets.dx[t2],dy=bullets.dy[t2],b=bullets.b[t2];
+    float hx=bullets.x_pos[t2]+b*dx,hy=bullets.y_pos[t2]+b*dy;
+    float s=(bullets.vx[t2]*dx+bullets.vy[t2]*dy)*(float)game->dt;
+    int last=-1;
+    for(int bounce=0;;bounce++)
+    {
+      float u=s;
+      if(sample && bounce<MAX_BOUNCES)
+      {
+        struct Sim_Leg leg={hx,hy,dx,dy,s,last};
+        legs.push_back(leg);
+      }
+      int mirror=bounce<MAX_BOUNCES ? reflection(game,hx,hy,dx,dy,s,last,&u) : -1;
+      float px=hx+u*dx,py=hy+u*dy;
+      hit_bricks(game->grid,hits,hx-1.1f*b*dx,hy-1.1f*b*dy,px+0.1f*b*dx,py+0.1f*b*dy);
+      hx=px;hy=py;
+      if(mirror==-1)
+        break;
+      // reflect direction and velocity about the mirror normal, d-2(d.n)n;
+      // as before the bullet turns around its head: the tail moves to the
+      // impact point and the body points along the reflected direction
+      float nx=game->mirror_nx[mirror],ny=game->mirror_ny[mirror];
+      float d=2*(dx*nx+dy*ny);
+      float v=2*(bullets.vx[t2]*nx+bullets.vy[t2]*ny);
+      dx-=d*nx;dy-=d*ny;
+      bullets.vx[t2]-=v*nx;bullets.vy[t2]-=v*ny;
+      hx+=b*dx;hy+=b*dy;
+      s-=u;
+      last=mirror;
+    }
+    bullets.dx[t2]=dx;bullets.dy[t2]=dy;
+    bullets.x_pos[t2]=hx-b*dx;
+    bullets.y_pos[t2]=hy-b*dy;
+  }
+}
+
+/* Distance along (dx,dy) from (hx,hy) to the edge of the playfield */
+static float field_exit(float hx,float hy,float dx,float dy)
+{
+  float t=INFINITY;
+  if(dx>0) t=fminf(t,(4-hx)/dx);
+  if(dx<0) t=fminf(t,(-4-hx)/dx);
+  if(dy>0) t=fminf(t,(4-hy)/dy);
+  if(dy<0) t=fminf(t,(-4-hy)/dy);
+  return fmaxf(t,0);
+}
+
+/* Follows the bullet head as move_bullets would over as many ticks as it
+   takes, one BVH query per leg */
+int Sim_Trace_Shot(const struct Game *game,const struct Sim_Gun *gun,double angle,float length,float *x,float *y,int max)
+{
+  if(max<2)
+    return 0;
+  double gun_length=gun->rect1.a+gun->rect2.a;
+  double cx=cos(angle*M_PI/180.0f),cy=sin(angle*M_PI/180.0f);
+  float dx=cx,dy=cy;
+  x[0]=-gun->rect1.a/2+gun->x_pos+gun_length*cx;
+  y[0]=-gun->rect1.b/2+gun->y_pos+gun_length*cy;
+  float hx=x[0]+BULLET_LENGTH*dx,hy=y[0]+BULLET_LENGTH*dy;
+  int n=1,last=-1;
+  while(n<max)
+  {
+    float s=fminf(length,field_exit(hx,hy,dx,dy)),u=s;
+    int mirror=n<max-1 ? reflection(game,hx,hy,dx,dy,s,last,&u) : -1;
+    x[n]=hx+u*dx;y[n]=hy+u*dy;
+    n++;
+    if(mirror==-1)
+      break;
+    float nx=game->mirror_nx[mirror],ny=game->mirror_ny[mirror];
+    float d=2*(dx*nx+dy*ny);
+    dx-=d*nx;dy-=d*ny;
+    hx=x[n-1]+BULLET_LENGTH*dx;hy=y[n-1]+BULLET_LENGTH*dy;
+    length-=u;
+    last=mirror;
+  }
+  return n;
+}
+
+static void catch_bricks(int chunk,void *arg)
+{
+  struct Game *game=(struct Game *)arg;
+  int begin=chunk*BRICK_CHUNK,end=std::min(begin+BRICK_CHUNK,game->bricks.pool.count);
+  game->chunk_score[chunk]=0;
+  game->chunk_lost[chunk]=0;
+  for(int i=0;i<2;i++)
+    bin_collection(game,&game->bin[i],begin,end,&game->chunk_score[chunk],&game->chunk_lost[chunk]);
+}
+
+static void fall_bricks(int chunk,void *arg)
+{
+  struct Game *game=(struct Game *)arg;
+  int begin=chunk*BRICK_CHUNK,end=std::min(begin+BRICK_CHUNK,game->bricks.pool.count);
+  // Speed_of_Brick is the fall per SIM_DT
+  const float fall=game->Speed_of_Brick*game->dt/SIM_DT;
+  float *y_pos=game->bricks.y_pos.data();
+  for(int j=begin;j<end;j++)
+    y_pos[j]-=fall;
+}
+
+/* Partial results are merged in chunk order, so the outcome does not depend
+   on the number of threads or on which thread ran which chunk */
+static void collision(struct Game *game)
+{
+  struct Sim_Bricks &bricks=game->bricks;
+  struct Sim_Bullets &bullets=game->bullets;
+  int brick_chunks=(bricks.pool.count+BRICK_CHUNK-1)/BRICK_CHUNK;
+  int bullet_chunks=(bullets.pool.count+BULLET_CHUNK-1)/BULLET_CHUNK;
+  if((int)game->chunk_score.size()<brick_chunks)
+  {
+    game->chunk_score.resize(brick_chunks);
+    game->chunk_lost.resize(brick_chunks);
+  }
+  if((int)game->chunk_hits.size()<bullet_chunks)
+  {
+    game->chunk_hits.resize(bullet_chunks);
+    game->chunk_legs.resize(bullet_chunks);
+  }
+
+  double t=Profile_Start(game->profile);
+  Thread_Pool_Run(game->threads,brick_chunks,catch_bricks,game);
+  for(int c=0;c<brick_chunks;c++)
+  {
+    game->Score+=game->chunk_score[c];
+    if(game->chunk_lost[c])
+      game->game_over=true;
+  }
+  Profile_Lap(game->profile,PHASE_CATCH,&t);
+
+  if(bullets.pool.count>0)
+    Grid_Build(&game->grid,bricks.x_pos.data(),bricks.y_pos.data(),bricks.b.data(),bricks.color.data(),bricks.pool.count);
+  Profile_Lap(game->profile,PHASE_GRID,&t);
+  Thread_Pool_Run(game->threads,bullet_chunks,move_bullets,game);
+  int *colors=bricks.color.data();
+  for(int c=0;c<bullet_chunks;c++)
+    for(size_t k=0;k<game->chunk_hits[c].size();k++)
+    {
+      int j=game->chunk_hits[c][k];
+      game->Score+=colors[j]==3;
+      colors[j]=-1;
+    }
+  Profile_Lap(game->profile,PHASE_BULLETS,&t);
+  game->leg_bullets=bullets.pool.count;
+
+  Thread_Pool_Run(game->threads,brick_chunks,fall_bricks,game);
+  Profile_Lap(game->profile,PHASE_FALL,&t);
+
+  if (game->tick%game->spawn_ticks==0)
+    CreateBrick(game);
+  Profile_Lap(game->profile,PHASE_SPAWN,&t);
+}
+
+/* Remove caught and hit bricks (tombstones), bricks that fell below the
+   playfield and bullets that left it, so the per-tick loops only ever see
+   live entities. Walks backwards so the entity swapped into a freed index
+   has already been checked */
+static void retire(struct Game *game)
+{
+  struct Sim_Bricks &bricks=game->bricks;
+  struct Sim_Bullets &bullets=game->bullets;
+  for(int j=bricks.pool.count-1;j>=0;j--)
+    if(bricks.color[j]==-1||bricks.y_pos[j]<GRID_MIN)
+      Sim_Remove_Brick(game,j);
+  for(int j=bullets.pool.count-1;j>=0;j--)
+    if(bullets.y_pos[j]<-4||bullets.y_pos[j]>4||bullets.x_pos[j]>4||bullets.x_pos[j]<-4)
+      Sim_Remove_Bullet(game,j);
+}
+
+/* Profiled ticks only: run the mirror queries of the legs kept by
+   move_bullets again on their own and scale them up to all bullets. Called
+   after the tick is timed, so the tick phase stays the cost of a tick */
+static void time_reflection(struct Game *game)
+{
+  int n=game->leg_bullets;
+  int chunks=(n+BULLET_CHUNK-1)/BULLET_CHUNK,sampled=0;
+  double t=Profile_Now();
+  for(int c=0;c<chunks;c++)
+  {
+    sampled+=(std::min(BULLET_CHUNK,n-c*BULLET_CHUNK)+REFLECT_SAMPLE-1)/REFLECT_SAMPLE;
+    for(size_t l=0;l<game->chunk_legs[c].size();l++)
+    {
+      const struct Sim_Leg &leg=game->chunk_legs[c][l];
+      float u;
+      reflection(game,leg.hx,leg.hy,leg.dx,leg.dy,leg.s,leg.last,&u);
+    }
+  }
+  Profile_Add(game->profile,PHASE_REFLECTION,sampled>0 ? (Profile_Now()-t)*n/sampled : 0);
+}
+
+void Sim_Step(struct Game *game)
+{
+  if(game->game_over && !game->endless)
+    return;
+  if(game->replay && Replay_Done(game->replay,game))
+    return;
+  double start=Profile_Start(game->profile),t=start;
+  game->tick++;
+  game->sim_time=game->tick*game->dt;
+  if(game->replay)
+    Replay_Apply(game->replay,game);
+  else if(game->input)
+    Sim_Drain_Input(game,game->input_epoch+game->sim_time);
+  Profile_Lap(game->profile,PHASE_INPUT,&t);
+  collision(game);
+  t=Profile_Start(game->profile);
+  retire(game);
+  Profile_Lap(game->profile,PHASE_RETIRE,&t);
+  if(game->rewind)
+    Rewind_Save(game->rewind,game);
+  Profile_Lap(game->profile,PHASE_REWIND,&t);
+  Profile_Lap(game->profile,PHASE_TICK,&start);
+  if(game->profile)
+    time_reflection(game);
+}
+
+int Sim_Advance(struct Game *game,double frame_time)
+{
+  int ticks=0;
+  if(frame_time>SIM_MAX_FRAME_TIME)
+  {
+    game->input_epoch+=frame_time-SIM_MAX_FRAME_TIME;   // the skipped time maps to no tick
+    frame_time=SIM_MAX_FRAME_TIME;
+  }
+  game->accumulator+=frame_time;
+  while(game->accumulator>=game->dt)
+  {
+    Sim_Step(game);
+    game->accumulator-=game->dt;
+    ticks++;
+  }
+  return ticks;
+}
+
+void Sim_Snapshot_Take(const struct Game *game,struct Sim_Snapshot *snap)
+{
+  const struct Sim_Bricks &bricks=game->bricks;
+  const struct Sim_Bullets &bullets=game->bullets;
+  int n=bricks.pool.count,m=bullets.pool.count;
+  snap->brick_x.assign(bricks.x_pos.begin(),bricks.x_pos.begin()+n);
+  snap->brick_y.assign(bricks.y_pos.begin(),bricks.y_pos.begin()+n);
+  snap->brick_color.assign(bricks.color.begin(),bricks.color.begin()+n);
+  snap->bullet_x.assign(bullets.x_pos.begin(),bullets.x_pos.begin()+m);
+  snap->bullet_y.assign(bullets.y_pos.begin(),bullets.y_pos.begin()+m);
+  snap->bullet_dx.assign(bullets.dx.begin(),bullets.dx.begin()+m);
+  snap->bullet_dy.assign(bullets.dy.begin(),bullets.dy.begin()+m);
+  snap->bin[0]=game->bin[0];
+  snap->bin[1]=game->bin[1];
+  snap->gun=game->gun;
+  snap->Score=game->Score;
+  snap->game_over=game->game_over;
+  snap->replay_done=game->replay && Replay_Done(game->replay,game);
+  snap->tick=game->tick;
+}
+
+static unsigned long long hash_bytes(unsigned long long h,const void *data,size_t size)
+{
+  const unsigned char *p=(const unsigned char *)data;
+  for(size_t k=0;k<size;k++)
+  {
+    h^=p[k];
+    h*=1099511628211ull;
+  }
+  return h;
+}
+
+unsigned long long Sim_Hash(const struct Game *game)
+{
+  const struct Sim_Bricks &bricks=game->bricks;
+  const struct Sim_Bullets &bullets=game->bullets;
+  int n=bricks.pool.count,m=bullets.pool.count;
+  unsigned long long h=14695981039346656037ull;
+  h=hash_bytes(h,&game->tick,sizeof(game->tick));
+  h=hash_bytes(h,&game->Score,sizeof(game->Score));
+  h=hash_bytes(h,&n,sizeof(n));
+  h=hash_bytes(h,bricks.x_pos.data(),n*sizeof(float));
+  h=hash_bytes(h,bricks.y_pos.data(),n*sizeof(float));
+  h=hash_bytes(h,bricks.color.data(),n*sizeof(int));
+  h=hash_bytes(h,&m,sizeof(m));
+  h=hash_bytes(h,bullets.x_pos.data(),m*sizeof(float));
+  h=hash_bytes(h,bullets.y_pos.data(),m*sizeof(float));
+  h=hash_bytes(h,bullets.dx.data(),m*sizeof(float));
+  h=hash_bytes(h,bullets.dy.data(),m*sizeof(float));
+  return h;
+}
@@ -0,0 +1,248 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <vector>
+
+#include "Sim_Grid.h"
+#include "Sim_BVH.h"
+
+struct Thread_Pool;
+struct Sim_Input_Ring;
+struct Sim_Recorder;
+struct Sim_Replay;
+struct Sim_Rewind;
+struct Sim_Profile;
+
+/* Game logic of the brick breaker, kept free of any GL/GLFW dependency so it
+   can be stepped without a window (see --headless in Sample_GL3_2D.cpp) */
+
+/* The simulation always advances in fixed ticks (SIM_DT seconds unless set
+   otherwise with Sim_Set_Tick), independent of the render frame rate;
+   Sim_Advance accumulates real frame time into ticks. Bullet collision is
+   swept, so longer ticks stay correct */
+#define SIM_DT 0.01
+#define SIM_MAX_FRAME_TIME 0.25
+#define BULLET_SPEED 9.0
+#define BULLET_LENGTH 0.8f
+#define BRICK_SPAWN_TIME 1.0
+#define RELOAD_TIME 0.5
+#define MAX_BOUNCES 4     // mirror bounces per bullet per tick
+
+/* Work units for the thread pool; fixed so results do not depend on the
+   number of threads */
+#define BULLET_CHUNK 64
+#define BRICK_CHUNK 4096
+
+/* Every game draws its random numbers from its own xorshift32 state, so a
+   game is reproduced exactly by its seed and its input (see Sim_Replay.h) */
+static inline unsigned int Sim_Rand(unsigned int *state)
+{
+  unsigned int x=*state;
+  x^=x<<13;
+  x^=x>>17;
+  x^=x<<5;
+  *state=x;
+  return x;
+}
+/* Non-zero generator state for a seed; different streams of one seed give
+   unrelated sequences */
+unsigned int Sim_Seed(unsigned int seed,unsigned int stream);
+
+/* Phases of Sim_Step timed into game->profile. Reflection (the mirror
+   queries) is part of bullets and summed over threads */
+enum Sim_Phase {
+  PHASE_INPUT,PHASE_CATCH,PHASE_GRID,PHASE_BULLETS,PHASE_REFLECTION,PHASE_FALL,
+  PHASE_SPAWN,PHASE_RETIRE,PHASE_REWIND,PHASE_TICK,SIM_PHASES
+};
+extern const char *const sim_phase_name[SIM_PHASES];
+
+struct Sim_Body {
+  double a;
+  double b;
+  double x_pos,y_pos,angle;
+  int color;
+};
+
+struct Sim_Bin {
+  double bin_height;
+  double bin_width;
+  double x_pos;
+  double y_pos;
+  int color;
+};
+
+struct Sim_Gun {
+  struct Sim_Body rect1,rect2;
+  double rot_angle;
+  double y_pos;
+  double x_pos;
+};
+
+/* Stable reference to an entity in a Sim_Pool. The generation is that of the
+   slot when the handle was issued, so a handle to a removed entity never
+   resolves to whatever reuses the slot */
+struct Sim_Handle {
+  unsigned int index;
+  unsigned int generation;
+};
+
+/* Slot map: the owner keeps its entities densely packed in [0,count) of its
+   own arrays, the pool maps slots to dense indices. Insert and remove are
+   O(1); removal moves the last entity into the hole */
+struct Sim_Pool {
+  std::vector<unsigned int> dense_of_slot;
+  std::vector<unsigned int> generation;
+  std::vector<unsigned int> slot_of_dense;
+  std::vector<unsigned int> free_slots;
+  int count;
+};
+
+/* Allocate a slot for a new entity at dense index pool->count-1 */
+struct Sim_Handle Pool_Insert(struct Sim_Pool *pool);
+/* Dense index of the entity, or -1 if the handle is stale */
+int Pool_Find(const struct Sim_Pool *pool,struct Sim_Handle handle);
+/* Free the entity at dense index i. Returns the dense index of the entity that
+   must be moved into i (the old last one, == new count); the owner copies its
+   fields from there and shrinks its arrays */
+int Pool_Remove(struct Sim_Pool *pool,int i);
+/* Free every entity; all handles issued so far go stale */
+void Pool_Clear(struct Sim_Pool *pool);
+
+/* Bricks and bullets are kept as structure-of-arrays pools: the per-tick
+   loops read only the fields they need from contiguous float arrays.
+   a is the width and b the length of the rectangle, as in Sim_Body.
+   Bullets carry a unit direction (dx,dy) and their velocity (vx,vy) instead
+   of an angle, so no trigonometry runs per tick */
+struct Sim_Bricks {
+  struct Sim_Pool pool;
+  std::vector<float> x_pos;
+  std::vector<float> y_pos;
+  std::vector<float> a;
+  std::vector<float> b;
+  std::vector<int> color;
+};
+
+struct Sim_Bullets {
+  struct Sim_Pool pool;
+  std::vector<float> x_pos;
+  std::vector<float> y_pos;
+  std::vector<float> dx;
+  std::vector<float> dy;
+  std::vector<float> vx;
+  std::vector<float> vy;
+  std::vector<float> a;
+  std::vector<float> b;
+};
+
+/* One straight stretch of a bullet's path within a tick, between mirror
+   bounces; a profiled tick keeps some to time the mirror queries apart */
+struct Sim_Leg {
+  float hx,hy,dx,dy,s;
+  int last;   // mirror just bounced off, -1 for none
+};
+
+struct Game {
+  struct Sim_Bricks bricks;
+  struct Sim_Bullets bullets;
+  struct Sim_Bin bin[2];
+  struct Sim_Gun gun;
+  // mirrors are static once the level is set up
+  std::vector<struct Sim_Body> mirror;
+  std::vector<float> mirror_x1,mirror_y1;   // endpoints, from Sim_Add_Mirror
+  std::vector<float> mirror_x2,mirror_y2;
+  std::vector<float> mirror_nx,mirror_ny;   // unit normals
+  int mirror_count;
+  struct Sim_BVH mirror_bvh;                // built by Sim_Build_Mirrors
+  int Score;
+  double Speed_of_Brick;
+  double dt;
+  int spawn_ticks;
+  long tick;
+  double sim_time;
+  double accumulator;
+  double time_to_hit_space;
+  bool game_over;
+  bool endless;    // keep playing after game over (stress runs)
+  struct Sim_Grid grid;   // broadphase scratch, rebuilt every tick
+  struct Thread_Pool *threads;   // NULL runs everything on the calling thread
+  struct Sim_Input_Ring *input;  // drained at the start of each tick, may be NULL
+  double input_epoch;            // Input_Clock() time of sim_time 0
+  struct Sim_Recorder *recorder; // logs every applied input, may be NULL
+  struct Sim_Replay *replay;     // replaces input when set
+  struct Sim_Rewind *rewind;     // keeps the end of every tick, may be NULL
+  struct Sim_Profile *profile;   // times the phases of each tick, may be NULL
+  unsigned int rng;              // Sim_Rand state
+  std::vector<std::vector<int> > chunk_hits;   // per bullet chunk scratch
+  std::vector<std::vector<struct Sim_Leg> > chunk_legs;   // profiled: legs of sampled bullets
+  int leg_bullets;                                        // bullets when they were kept
+  std::vector<int> chunk_score,chunk_lost;      // per brick chunk scratch
+};
+
+/* What the renderer needs of a Game, copied out after a tick so it can be
+   drawn on another thread while the simulation moves on. Only live
+   entities, in dense order. Mirrors never move and are read from the Game */
+struct Sim_Snapshot {
+  std::vector<float> brick_x,brick_y;
+  std::vector<int> brick_color;
+  std::vector<float> bullet_x,bullet_y,bullet_dx,bullet_dy;
+  struct Sim_Bin bin[2];
+  struct Sim_Gun gun;
+  int Score;
+  bool game_over;
+  bool replay_done;
+  long tick;
+};
+
+/* Start a game on the default level */
+void Sim_Init(struct Game *game,unsigned int seed);
+/* Level setup: mirrors added with Sim_Add_Mirror (length along the angle
+   in degrees) take effect after Sim_Build_Mirrors */
+void Sim_Clear_Mirrors(struct Game *game);
+void Sim_Add_Mirror(struct Game *game,double x_pos,double y_pos,double angle,double length);
+void Sim_Build_Mirrors(struct Game *game);
+/* Take over the level of another game, BVH included */
+void Sim_Copy_Mirrors(struct Game *game,const struct Game *from);
+/* Replace the mirrors with those of a level file, one "x y angle length"
+   per line, # starts a comment; false if it cannot be read */
+bool Sim_Load_Level(struct Game *game,const char *path);
+/* Replace the mirrors with n short ones scattered over the playfield */
+void Sim_Scatter_Mirrors(struct Game *game,int n,unsigned int seed);
+/* Change the tick length (default SIM_DT) */
+void Sim_Set_Tick(struct Game *game,double dt);
+/* Advance the game by exactly one tick. Queued input stamped up to
+   input_epoch+sim_time of the new tick is applied first, or the input the
+   replay holds for the tick. A finished replay stops the game. The
+   resulting state is kept in game->rewind if set, and the phases are
+   timed into game->profile if set */
+void Sim_Step(struct Game *game);
+/* Add frame_time seconds of real time and run as many whole ticks as fit;
+   returns the number of ticks run. Frame times above SIM_MAX_FRAME_TIME are
+   clamped so a stall does not snowball into ever longer catch-up frames */
+int Sim_Advance(struct Game *game,double frame_time);
+/* Fire a bullet along gun.rot_angle if RELOAD_TIME of sim time has elapsed */
+bool Sim_Fire(struct Game *game);
+bool Sim_Can_Fire(const struct Game *game);
+/* Predicted path of a shot fired from gun at angle (degrees): the muzzle,
+   then each point where the bullet head meets a mirror, then where it
+   leaves the playfield or has covered length. Writes up to max points to
+   x,y and returns how many. Reads only the gun and the mirrors, which are
+   fixed once the level is set up, so the render thread may call it while
+   the simulation runs */
+int Sim_Trace_Shot(const struct Game *game,const struct Sim_Gun *gun,double angle,float length,float *x,float *y,int max);
+
+void CreateBrick(struct Game *game);
+void CreateBullet(struct Game *game);
+struct Sim_Handle Sim_Add_Brick(struct Game *game,float x_pos,float y_pos,int color);
+/* (dx,dy) must be a unit vector */
+struct Sim_Handle Sim_Add_Bullet(struct Game *game,float x_pos,float y_pos,float dx,float dy);
+void Sim_Remove_Brick(struct Game *game,int i);
+void Sim_Remove_Bullet(struct Game *game,int i);
+/* Scatter n random bricks over the playfield, for stress runs */
+void Sim_Populate(struct Game *game,int n);
+/* 64-bit FNV-1a over tick, score, bricks and bullets, to check that two runs
+   ended in the same state */
+unsigned long long Sim_Hash(const struct Game *game);
+/* Copy the drawable state into snap, reusing its storage */
+void Sim_Snapshot_Take(const struct Game *game,struct Sim_Snapshot *snap);
+
+#endif
@@ -0,0 +1,140 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Thread_Pool.h"
+
+/* The tasks a participant starts with, [next,end) packed in one word so
+   the owner and thieves claim them alike with a single fetch_add, and a
+   new batch is published with a single store */
+struct Task_Range {
+  std::atomic<unsigned long long> range;   // end<<32 | next
+  char pad[64-sizeof(std::atomic<unsigned long long>)];   // one per cache line
+};
+
+struct Thread_Pool {
+  int size;
+  std::vector<std::thread> threads;
+  Task_Range *ranges;              // one per participant, 0 is the caller
+  std::mutex lock;
+  std::condition_variable wake,done;
+  unsigned long job;
+  bool quit;
+  Thread_Task_Fn fn;
+  void *arg;
+  std::atomic<int> remaining;
+};
+
+static bool claim_task(Task_Range *range,int *task)
+{
+  // cheap check first, so empty ranges are not written to by every scan
+  unsigned long long v=range->range.load(std::memory_order_relaxed);
+  if((unsigned int)v>=(unsigned int)(v>>32))
+    return false;
+  v=range->range.fetch_add(1);
+  if((unsigned int)v>=(unsigned int)(v>>32))
+    return false;
+  *task=(unsigned int)v;
+  return true;
+}
+
+/* Work through its own range, then take what is left in the others' */
+static void run_tasks(struct Thread_Pool *pool,int self)
+{
+  int task;
+  for(int k=0;k<pool->size;k++)
+  {
+    Task_Range *range=&pool->ranges[(self+k)%pool->size];
+    while(claim_task(range,&task))
+    {
+      pool->fn(task,pool->arg);
+      if(pool->remaining.fetch_sub(1)==1)
+      {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->done.notify_all();
+      }
+    }
+  }
+}
+
+static void worker(struct Thread_Pool *pool,int self)
+{
+  unsigned long seen=0;
+  for(;;)
+  {
+    {
+      std::unique_lock<std::mutex> guard(pool->lock);
+      pool->wake.wait(guard,[&]{ return pool->quit || pool->job!=seen; });
+      if(pool->quit)
+        return;
+      seen=pool->job;
+    }
+    run_tasks(pool,self);
+  }
+}
+
+struct Thread_Pool *Thread_Pool_Create(int threads)
+{
+  struct Thread_Pool *pool=new Thread_Pool;
+  pool->size=threads<1 ? 1 : threads;
+  pool->ranges=new Task_Range[pool->size];
+  for(int i=0;i<pool->size;i++)
+    pool->ranges[i].range=0;
+  pool->job=0;
+  pool->quit=false;
+  pool->fn=NULL;
+  pool->arg=NULL;
+  pool->remaining=0;
+  for(int i=1;i<pool->size;i++)
+    pool->threads.push_back(std::thread(worker,pool,i));
+  return pool;
+}
+
+void Thread_Pool_Destroy(struct Thread_Pool *pool)
+{
+  if(!pool)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->quit=true;
+  }
+  pool->wake.notify_all();
+  for(size_t i=0;i<pool->threads.size();i++)
+    pool->threads[i].join();
+  delete[] pool->ranges;
+  delete pool;
+}
+
+int Thread_Pool_Size(const struct Thread_Pool *pool)
+{
+  return pool ? pool->size : 1;
+}
+
+void Thread_Pool_Run(struct Thread_Pool *pool,int tasks,Thread_Task_Fn fn,void *arg)
+{
+  if(!pool || pool->size==1 || tasks<=1)
+  {
+    for(int task=0;task<tasks;task++)
+      fn(task,arg);
+    return;
+  }
+  pool->fn=fn;
+  pool->arg=arg;
+  pool->remaining=tasks;
+  // participant i starts with the i-th contiguous slice of the tasks
+  for(int i=0;i<pool->size;i++)
+  {
+    unsigned long long begin=(long long)tasks*i/pool->size,end=(long long)tasks*(i+1)/pool->size;
+    pool->ranges[i].range.store(end<<32|begin);
+  }
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->job++;
+  }
+  pool->wake.notify_all();
+  run_tasks(pool,0);
+  std::unique_lock<std::mutex> guard(pool->lock);
+  pool->done.wait(guard,[&]{ return pool->remaining==0; });
+}
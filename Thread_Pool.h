@@ -0,0 +1,22 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/* Fixed set of worker threads running batches of numbered tasks. Each
+   participant (the calling thread is one of them) starts with its own
+   contiguous slice of the tasks and, once that is done, takes tasks left
+   in the others' slices, so uneven tasks balance out across cores. Tasks
+   are claimed with one atomic add each; no lock is taken per task */
+struct Thread_Pool;
+
+typedef void (*Thread_Task_Fn)(int task,void *arg);
+
+/* threads counts the caller, so 1 creates no worker threads */
+struct Thread_Pool *Thread_Pool_Create(int threads);
+void Thread_Pool_Destroy(struct Thread_Pool *pool);
+int Thread_Pool_Size(const struct Thread_Pool *pool);
+
+/* Run fn(task,arg) for every task in [0,tasks) and return once all are done.
+   pool may be NULL to run them in order on the calling thread */
+void Thread_Pool_Run(struct Thread_Pool *pool,int tasks,Thread_Task_Fn fn,void *arg);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/* Lock-free single producer / single consumer triple buffer. The writer fills
+   Write_Slot() and calls Publish(); the reader calls Read() to get the most
+   recently published slot. Neither side ever waits: the writer owns one slot,
+   the reader another, and the third is handed over with an atomic exchange.
+   A slot the reader holds is never touched by the writer, so it stays
+   unchanged until the next Read() */
+
+#define TRIPLE_BUFFER_FRESH 4   // set on the shared index when it holds an unread slot
+
+template <class T>
+struct Triple_Buffer {
+  T slot[3];
+  int back;                  // writer only
+  int front;                 // reader only
+  std::atomic<int> middle;   // slot index | TRIPLE_BUFFER_FRESH
+
+  Triple_Buffer() : slot(), back(0), front(1), middle(2) {}
+
+  T &Write_Slot() { return slot[back]; }
+
+  void Publish()
+  {
+    back=middle.exchange(back|TRIPLE_BUFFER_FRESH,std::memory_order_acq_rel)&3;
+  }
+
+  const T &Read()
+  {
+    if(middle.load(std::memory_order_relaxed)&TRIPLE_BUFFER_FRESH)
+      front=middle.exchange(front,std::memory_order_acq_rel)&3;
+    return slot[front];
+  }
+};
+
+#endif